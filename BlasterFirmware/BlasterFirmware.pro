@@ -8,30 +8,52 @@ CORTEX_M3_LINKERSCRIPT = $$quote($$PWD/linker.ld)
 include(/home/felix/projects/lowlevel/cortex-m3-template/cortex-m3.pri)
 
 SOURCES += \
+  identity.cpp \
   main.cpp \
+  modules/copy_flash.cpp \
   modules/data_loader.cpp \
+  modules/device_info.cpp \
   modules/erase_and_write.cpp \
   modules/erase_sectors.cpp \
+  modules/fill_memory.cpp \
+  modules/flash_layout.cpp \
+  modules/hash_sectors.cpp \
+  modules/memory_map.cpp \
   modules/readback_memory.cpp \
   modules/system_main.cpp \
-  modules/zero_memory.cpp \
+  modules/version_info.cpp \
   sector_table.cpp \
   serial.cpp \
-  sysinit.cpp
+  sysclock.cpp \
+  sysinit.cpp \
+  workbuf.cpp
 
 DISTFILES += \
   linker.ld
 
 HEADERS += \
+  crc32.hpp \
   errorcode.hpp \
+  identity.hpp \
+  modules/copy_flash.hpp \
   modules/data_loader.hpp \
+  modules/device_info.hpp \
   modules/erase_and_write.hpp \
   modules/erase_sectors.hpp \
+  modules/fill_memory.hpp \
+  modules/flash_layout.hpp \
+  modules/hash_sectors.hpp \
+  modules/memory_map.hpp \
   modules/modules.hpp \
   modules/readback_memory.hpp \
   modules/system_main.hpp \
-  modules/zero_memory.hpp \
+  modules/version_info.hpp \
+  packet.hpp \
+  protocol.hpp \
+  reed_solomon.hpp \
   sector_table.hpp \
   serial.hpp \
+  sysclock.hpp \
   sysctrl.hpp \
-  system.hpp
+  system.hpp \
+  workbuf.hpp
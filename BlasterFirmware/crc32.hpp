@@ -0,0 +1,73 @@
+#ifndef CRC32_HPP
+#define CRC32_HPP
+
+#include <cstdint>
+#include <cstddef>
+
+//! CRC-32 (IEEE 802.3, same as zlib), shared by firmware and host.
+//! Computed bitwise by default, as the loader has no room for a table.
+namespace crc32
+{
+	static constexpr uint32_t initial = 0xFFFFFFFFU;
+
+	//! Continues a CRC over `length` bytes. Start with `initial`
+	//! and pass the result through `finish()`.
+	inline uint32_t update(uint32_t crc, void const * data, size_t length)
+	{
+		uint8_t const * buf = reinterpret_cast<uint8_t const *>(data);
+		for(size_t i = 0; i < length; i++)
+		{
+			crc ^= buf[i];
+			for(int bit = 0; bit < 8; bit++)
+				crc = (crc >> 1) ^ (0xEDB88320U & (0U - (crc & 1U)));
+		}
+		return crc;
+	}
+
+	inline uint32_t finish(uint32_t crc)
+	{
+		return ~crc;
+	}
+
+	inline uint32_t compute(void const * data, size_t length)
+	{
+		return finish(update(initial, data, length));
+	}
+
+	struct Table
+	{
+		uint32_t entries[256];
+	};
+
+	constexpr Table make_table()
+	{
+		Table table { };
+		for(uint32_t i = 0; i < 256; i++)
+		{
+			uint32_t crc = i;
+			for(int bit = 0; bit < 8; bit++)
+				crc = (crc >> 1) ^ (0xEDB88320U & (0U - (crc & 1U)));
+			table.entries[i] = crc;
+		}
+		return table;
+	}
+
+	//! Lookup table for update_fast(), only linked in where it is used.
+	static constexpr Table table = make_table();
+
+	//! Same as update(), but with a 1 kB table, about eight times faster.
+	inline uint32_t update_fast(uint32_t crc, void const * data, size_t length)
+	{
+		uint8_t const * buf = reinterpret_cast<uint8_t const *>(data);
+		for(size_t i = 0; i < length; i++)
+			crc = (crc >> 8) ^ table.entries[(crc ^ buf[i]) & 0xFFU];
+		return crc;
+	}
+
+	inline uint32_t compute_fast(void const * data, size_t length)
+	{
+		return finish(update_fast(initial, data, length));
+	}
+}
+
+#endif // CRC32_HPP
@@ -12,6 +12,7 @@ enum class ErrorCode : uint8_t
 	NotAligned      = 0x04,
 	IAPFailure      = 0x05,
 	UnknownCommand  = 0x06,
+	ReceiveOverrun  = 0x07,
 };
 
 #endif // ERROR_HPP
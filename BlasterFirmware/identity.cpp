@@ -0,0 +1,58 @@
+#include "identity.hpp"
+
+namespace
+{
+	// The IAP entry is in the boot ROM, bit 0 selects thumb mode.
+	using IAP = void (*)(uint32_t const * command, uint32_t * result);
+	IAP const iap_entry = reinterpret_cast<IAP>(0x1FFF1FF1);
+
+	// commands that are not covered by hal/iap.hpp
+	constexpr uint32_t IAP_READ_PART_ID = 54;
+	constexpr uint32_t IAP_READ_BOOT_CODE_VERSION = 55;
+	constexpr uint32_t IAP_READ_DEVICE_SERIAL_NUMBER = 58;
+	constexpr uint32_t IAP_CMD_SUCCESS = 0;
+
+	uint32_t current_part_id;
+	uint32_t current_boot_version;
+	uint32_t current_serial[4];
+
+	//! Runs `command` and stores the result words behind the status in `result`.
+	bool call(uint32_t command, uint32_t (&result)[4])
+	{
+		uint32_t const params[5] = { command };
+		uint32_t status[5] = { };
+		iap_entry(params, status);
+		if(status[0] != IAP_CMD_SUCCESS)
+			return false;
+		for(int i = 0; i < 4; i++)
+			result[i] = status[i + 1];
+		return true;
+	}
+}
+
+void identity::init()
+{
+	uint32_t result[4];
+
+	current_part_id = call(IAP_READ_PART_ID, result) ? result[0] : 0;
+	current_boot_version = call(IAP_READ_BOOT_CODE_VERSION, result) ? result[0] : 0;
+	if(not call(IAP_READ_DEVICE_SERIAL_NUMBER, current_serial)) {
+		for(auto & word : current_serial)
+			word = 0;
+	}
+}
+
+uint32_t identity::part_id()
+{
+	return current_part_id;
+}
+
+uint32_t identity::boot_version()
+{
+	return current_boot_version;
+}
+
+uint32_t const (&identity::serial())[4]
+{
+	return current_serial;
+}
@@ -0,0 +1,23 @@
+#ifndef IDENTITY_HPP
+#define IDENTITY_HPP
+
+#include <cstdint>
+
+//! Identification of the running part, read through the IAP once at
+//! startup, as the IAP takes some time and needs the top of the local SRAM.
+namespace identity
+{
+	//! Reads all values. Must be called before any other function.
+	void init();
+
+	//! Part ID, 0 if the IAP failed.
+	uint32_t part_id();
+
+	//! Version of the boot ROM, major version in bits 8…15, minor in 0…7.
+	uint32_t boot_version();
+
+	//! The 128 bit device serial number, least significant word first.
+	uint32_t const (&serial())[4];
+}
+
+#endif // IDENTITY_HPP
@@ -4,53 +4,50 @@
 #include <hal/gpio.hpp>
 #include <hal/iap.hpp>
 #include "serial.hpp"
+#include "identity.hpp"
+#include "sector_table.hpp"
 #include "modules/modules.hpp"
 #include "sysctrl.hpp"
 
-static sysctrl::SerialHandler serialHandler;
-
-static sysctrl::state current_state;
-
-sysctrl::state sysctrl::go(sysctrl::SerialHandler h, sysctrl::state initial_state)
+// Bytes were dropped on the way to the command being answered or the one
+// before, so neither the reply nor the position in the stream is right.
+static bool report_overrun()
 {
-	current_state = initial_state;
-	serialHandler = h;
-	return initial_state;
+	if(not Serial::overrun())
+		return false;
+	Serial::tx('\025');
+	Serial::tx(uint8_t(ErrorCode::ReceiveOverrun));
+	Serial::tx(uint8_t(0));
+	return true;
 }
 
 void sysctrl::acknowledge()
 {
+	if(report_overrun())
+		return;
 	Serial::tx('\006');
 }
 
-sysctrl::state sysctrl::return_to_main(bool suppress_ack)
-{
-	if(not suppress_ack)
-		acknowledge();
-	return -1;
-}
-
-sysctrl::state sysctrl::return_to_main(ErrorCode code, uint8_t info)
+void sysctrl::nak(ErrorCode code, uint8_t info)
 {
+	if(report_overrun())
+		return;
 	Serial::tx('\025');
 	Serial::tx(uint8_t(code));
 	Serial::tx(info);
-	return -1;
 }
 
 // fancy thing is:
 // we get our CPU and UART set up already from the ISP!
 int main()
 {
+	workbuf::init();
+	identity::init();
+	sector_table::init();
+	Serial::enable_receive_buffer();
+
 	Serial::tx("LPCBlaster ready.\r\n");
 
-	current_state = -1;
 	while(true)
-	{
-		if(current_state == -1)
-			system_main::begin();
-
-		char c = Serial::rx();
-		current_state = serialHandler(current_state, uint8_t(c));
-	}
+		system_main::dispatch(Serial::rx());
 }
@@ -0,0 +1,24 @@
+#include "copy_flash.hpp"
+#include "sector_table.hpp"
+
+#include <cstring>
+
+void copy_flash::execute(uint32_t flash_offset, uint32_t work_offset, uint32_t length)
+{
+	if(length == 0)
+		return sysctrl::nak(ErrorCode::InvalidLength);
+
+	if(not workbuf::contains(work_offset, length))
+		return sysctrl::nak(ErrorCode::OutOfRange, 1);
+
+	uint32_t end;
+	if(__builtin_add_overflow(flash_offset, length, &end) or end > sector_table::flash_size())
+		return sysctrl::nak(ErrorCode::OutOfRange, 2);
+
+	auto const * source = reinterpret_cast<uint8_t const *>(flash_offset);
+	workbuf::for_each(work_offset, length, [&](uint8_t * ptr, uint32_t len) {
+		memcpy(ptr, source, len);
+		source += len;
+	});
+	sysctrl::acknowledge();
+}
@@ -0,0 +1,13 @@
+#ifndef COPY_FLASH_HPP
+#define COPY_FLASH_HPP
+
+#include "sysctrl.hpp"
+
+namespace copy_flash
+{
+	//! C: copies flash to the work buffer, so a sector can be patched
+	//! with a few loads and written back with w.
+	void execute(uint32_t flash_offset, uint32_t work_offset, uint32_t length);
+}
+
+#endif // COPY_FLASH_HPP
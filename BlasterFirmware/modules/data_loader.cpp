@@ -1,79 +1,183 @@
 #include "data_loader.hpp"
-#include "sysctrl.hpp"
+#include "packet.hpp"
 #include "serial.hpp"
+#include "protocol.hpp"
+#include "reed_solomon.hpp"
+#include "crc32.hpp"
+
+template<typename T>
+void data_loader::execute(T offset, T length)
+{
+	if(length == 0) {
+		Serial::skip(sizeof(uint16_t));
+		return sysctrl::nak(ErrorCode::InvalidLength);
+	}
+
+	if(not workbuf::contains(offset, length)) {
+		// stay in sync with the host, drop data and checksum
+		packet::discard(length, workbuf::size(), sizeof(uint16_t));
+		return sysctrl::nak(ErrorCode::OutOfRange);
+	}
+
+	uint16_t local_checksum = 0;
+	workbuf::for_each(offset, length, [&](uint8_t * ptr, uint32_t len) {
+		local_checksum += Serial::rx(ptr, len);
+	});
+	uint16_t const remote_checksum = packet::read<uint16_t>();
+	if(remote_checksum != local_checksum)
+		return sysctrl::nak(ErrorCode::InvalidChecksum);
+
+	sysctrl::acknowledge();
+}
 
 namespace
 {
-	enum State {
-		ReadOffset0 = 0,
-		ReadOffset1,
-		ReadLength0,
-		ReadLength1,
-		ReadData,
-		ReadChecksum0,
-		ReadChecksum1,
+	//! Writes the decoded data byte by byte into the work buffer.
+	struct Cursor
+	{
+		uint32_t offset;
+		uint32_t end;
+		uint8_t * ptr = nullptr;
+		uint32_t contiguous = 0;
+
+		bool put(uint8_t value)
+		{
+			if(offset == end)
+				return false;
+			if(contiguous == 0)
+				ptr = workbuf::address(offset, contiguous);
+			*ptr++ = value;
+			contiguous -= 1;
+			offset += 1;
+			return true;
+		}
 	};
+}
+
+void data_loader::execute_rle(uint32_t offset, uint32_t length, uint32_t encoded_length)
+{
+	// the host only sends u when the encoding is smaller than the data
+	if(length == 0 or encoded_length == 0) {
+		packet::discard(encoded_length, workbuf::size(), sizeof(uint16_t));
+		return sysctrl::nak(ErrorCode::InvalidLength);
+	}
 
-	uint16_t offset;
-	uint16_t length;
-	uint16_t local_checksum, remote_checksum;
+	if(not workbuf::contains(offset, length)) {
+		packet::discard(encoded_length, workbuf::size(), sizeof(uint16_t));
+		return sysctrl::nak(ErrorCode::OutOfRange);
+	}
 
-	sysctrl::state rcv(sysctrl::state state, uint8_t val)
+	// decode while receiving, but always consume the whole
+	// packet to stay in sync with the host
+	Cursor output { offset, offset + length };
+	uint16_t local_checksum = 0;
+	uint32_t literals = 0;
+	uint32_t repeats = 0;
+	bool overflow = false;
+	for(uint32_t i = 0; i < encoded_length; i++)
 	{
-		switch(State(state))
-		{
-			case ReadOffset0:
-				offset = val;
-				return ReadOffset1;
-
-			case ReadOffset1:
-				offset |= uint16_t(val) << 8;
-				return ReadLength0;
-
-			case ReadLength0:
-				length = val;
-				return ReadLength1;
-
-			case ReadLength1:
-				length |= uint16_t(val) << 8;
-				if(length > 0) {
-					if(uint32_t(offset) + length > sizeof(ahbram))
-						return sysctrl::return_to_main(ErrorCode::OutOfRange);
-					return ReadData;
-				}
-				else {
-					return sysctrl::return_to_main(ErrorCode::InvalidLength);
-				}
-
-			case ReadData:
-				ahbram[offset++] = val;
-				local_checksum += val;
-				length -= 1;
-				if(length == 0)
-					return ReadChecksum0;
-				else
-					return ReadData;
-
-			case ReadChecksum0:
-				remote_checksum = val;
-				return ReadChecksum1;
-
-			case ReadChecksum1:
-				remote_checksum |= uint16_t(val) << 8;
-				if(remote_checksum != local_checksum)
-					return sysctrl::return_to_main(ErrorCode::InvalidChecksum);
-				else
-					return sysctrl::return_to_main();
+		uint8_t const c = uint8_t(Serial::rx());
+		local_checksum += c;
+		if(literals > 0) {
+			overflow |= not output.put(c);
+			literals -= 1;
+		}
+		else if(repeats > 0) {
+			for(; repeats > 0; repeats--)
+				overflow |= not output.put(c);
+		}
+		else if(c < 0x80) {
+			literals = c + 1U;
+		}
+		else {
+			repeats = (c & 0x7FU) + 3U;
 		}
-		return sysctrl::return_to_main(ErrorCode::UnknownState);
 	}
+
+	uint16_t const remote_checksum = packet::read<uint16_t>();
+	if(remote_checksum != local_checksum)
+		return sysctrl::nak(ErrorCode::InvalidChecksum);
+
+	// runs must end with the packet and fill exactly `length` bytes
+	if(overflow or literals > 0 or repeats > 0 or output.offset != output.end)
+		return sysctrl::nak(ErrorCode::InvalidLength, 1);
+
+	sysctrl::acknowledge();
 }
 
-sysctrl::state data_loader::begin()
+namespace
 {
-	remote_checksum = 0;
-	local_checksum = 0;
-	length = 0;
-	offset = 0;
-	return sysctrl::go(&rcv, ReadOffset0);
+	uint32_t little_endian(uint8_t const * bytes, size_t size)
+	{
+		uint32_t value = 0;
+		for(size_t i = 0; i < size; i++)
+			value |= uint32_t(bytes[i]) << (8 * i);
+		return value;
+	}
 }
+
+void data_loader::execute_fec()
+{
+	uint8_t header[9 + fec_header_parity];
+	Serial::rx(header, sizeof header);
+
+	// without a header the block layout is unknown, so a header that can't
+	// be corrected or decodes to nonsense leaves the blaster out of sync
+	bool const valid = reed_solomon::decode(header, sizeof header, fec_header_parity) >= 0;
+	uint32_t const offset = little_endian(&header[0], 4);
+	uint32_t const length = little_endian(&header[4], 4);
+	uint32_t const parity = header[8];
+	if(not valid or length == 0 or parity == 0 or parity > fec_max_parity)
+		return sysctrl::nak(ErrorCode::InvalidChecksum, fec_header_lost);
+
+	uint32_t const block_data = reed_solomon::max_block - parity;
+	uint32_t const blocks = (length + block_data - 1) / block_data;
+	if(not workbuf::contains(offset, length)) {
+		packet::discard(length, workbuf::size(), blocks * parity);
+		return sysctrl::nak(ErrorCode::OutOfRange);
+	}
+
+	// decode each block as it arrives, the receive buffer takes the
+	// following bytes meanwhile
+	uint8_t block[reed_solomon::max_block];
+	uint16_t lost[fec_max_lost];
+	uint32_t lost_count = 0;
+	uint32_t corrected = 0;
+	uint32_t crc = crc32::initial;
+	for(uint32_t i = 0; i < blocks; i++)
+	{
+		uint32_t const start = i * block_data;
+		uint32_t const size = (length - start < block_data) ? (length - start) : block_data;
+		Serial::rx(block, size + parity);
+
+		int const result = reed_solomon::decode(block, size + parity, parity);
+		if(result < 0) {
+			if(lost_count < fec_max_lost)
+				lost[lost_count] = uint16_t(i);
+			lost_count += 1;
+			continue;
+		}
+		corrected += uint32_t(result);
+		crc = crc32::update_fast(crc, block, size);
+
+		uint32_t copied = 0;
+		workbuf::for_each(offset + start, size, [&](uint8_t * ptr, uint32_t len) {
+			for(uint32_t j = 0; j < len; j++)
+				ptr[j] = block[copied + j];
+			copied += len;
+		});
+	}
+
+	if(lost_count > fec_max_lost)
+		return sysctrl::nak(ErrorCode::InvalidChecksum);
+
+	sysctrl::acknowledge();
+	packet::write<uint16_t>(uint16_t(corrected > 0xFFFF ? 0xFFFF : corrected));
+	packet::write<uint32_t>(crc32::finish(crc));
+	packet::write<uint16_t>(uint16_t(lost_count));
+	for(uint32_t i = 0; i < lost_count; i++)
+		packet::write<uint16_t>(lost[i]);
+}
+
+template void data_loader::execute<uint16_t>(uint16_t, uint16_t);
+template void data_loader::execute<uint32_t>(uint32_t, uint32_t);
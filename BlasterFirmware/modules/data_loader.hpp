@@ -5,7 +5,26 @@
 
 namespace data_loader
 {
-	sysctrl::state begin();
+	//! L uses u16 fields, l (protocol v2) u32 fields.
+	template<typename T>
+	void execute(T offset, T length);
+
+	extern template void execute<uint16_t>(uint16_t, uint16_t);
+	extern template void execute<uint32_t>(uint32_t, uint32_t);
+
+	//! u: loads run length encoded data, `length` is the decoded size.
+	//! Each run starts with a control byte c:
+	//!   c < 0x80: c+1 literal bytes follow
+	//!   c ≥ 0x80: the next byte is repeated (c & 0x7F) + 3 times
+	void execute_rle(uint32_t offset, uint32_t length, uint32_t encoded_length);
+
+	//! D: loads data protected by a Reed-Solomon code (see reed_solomon.hpp).
+	//! The header (offset:u32, length:u32, parity:u8) is followed by
+	//! fec_header_parity check bytes, the data by blocks of 255-parity bytes
+	//! (the last may be shorter) with `parity` check bytes each. Correctable
+	//! blocks are stored, the reply lists the others and has the CRC-32 of
+	//! the stored blocks, so the host detects wrong corrections.
+	void execute_fec();
 }
 
 #endif // DATA_LOADER_HPP
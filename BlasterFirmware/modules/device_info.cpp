@@ -0,0 +1,31 @@
+#include "device_info.hpp"
+#include "version_info.hpp"
+#include "identity.hpp"
+#include "sector_table.hpp"
+#include "sysclock.hpp"
+#include "workbuf.hpp"
+#include "protocol.hpp"
+#include "packet.hpp"
+#include "serial.hpp"
+
+void device_info::execute()
+{
+	sysctrl::acknowledge();
+	Serial::tx(protocol_version);
+	packet::write<uint32_t>(version_info::features);
+	packet::write<uint32_t>(identity::part_id());
+	packet::write<uint32_t>(identity::boot_version());
+	for(uint32_t word : identity::serial())
+		packet::write<uint32_t>(word);
+	packet::write<uint32_t>(sysclock::cclk());
+	packet::write<uint32_t>(Serial::baudrate());
+	packet::write<uint32_t>(sector_table::flash_size());
+	packet::write<uint32_t>(workbuf::size());
+	Serial::tx(char(workbuf::region_count()));
+	for(size_t i = 0; i < workbuf::region_count(); i++)
+	{
+		auto const & region = workbuf::region(i);
+		packet::write<uint32_t>(reinterpret_cast<uintptr_t>(region.start));
+		packet::write<uint32_t>(region.length);
+	}
+}
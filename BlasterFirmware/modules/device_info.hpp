@@ -0,0 +1,14 @@
+#ifndef DEVICE_INFO_HPP
+#define DEVICE_INFO_HPP
+
+#include "sysctrl.hpp"
+
+namespace device_info
+{
+	//! Everything the host needs to know in one reply: version and
+	//! features (see V), part and flash (see T), work buffer (see M)
+	//! and the clock and baud rate the blaster runs with.
+	void execute();
+}
+
+#endif // DEVICE_INFO_HPP
@@ -1,151 +1,187 @@
 #include "erase_and_write.hpp"
 #include "sector_table.hpp"
-#include "system.hpp"
+#include "sysclock.hpp"
+#include "packet.hpp"
+#include "serial.hpp"
 #include <hal/iap.hpp>
 #include <optional>
 
 namespace
 {
-	enum State {
-		ReadFlashOffset0 = 0,
-		ReadFlashOffset1,
-		ReadFlashOffset2,
-		ReadFlashOffset3,
-		ReadWorkOffset0,
-		ReadWorkOffset1,
-		ReadLength0,
-		ReadLength1,
-	};
+	//! Returns the largest block size accepted by copy_ram_to_flash
+	//! that is not larger than `remaining` (a multiple of 256).
+	static inline uint32_t block_size(uint32_t remaining)
+	{
+		if(remaining >= 4096)
+			return 4096;
+		if(remaining >= 1024)
+			return 1024;
+		if(remaining >= 512)
+			return 512;
+		return 256;
+	}
 
-	uint32_t flash_offset;
-	uint16_t work_offset;
-	uint16_t length;
+	struct SectorRange
+	{
+		uint32_t first, last;
+	};
 
-	static inline std::optional<uint32_t> find_sector_for_address(uint32_t address)
+	//! Validates the parameters of W, w and p. Sends NAK on failure.
+	std::optional<SectorRange> check(uint32_t flash_offset, uint32_t work_offset, uint32_t length)
 	{
-		for(size_t i = 0; i < std::size(sector_table); i++)
-		{
-			if(address < sector_table[i].start_address)
-				continue;
-			if(address >= sector_table[i].start_address + sector_table[i].length)
-				continue;
-			return uint32_t(i);
+		if(length == 0) {
+			sysctrl::nak(ErrorCode::InvalidLength);
+			return std::nullopt;
 		}
-		return std::nullopt;
+
+		if(not workbuf::contains(work_offset, length)) {
+			sysctrl::nak(ErrorCode::OutOfRange, 1);
+			return std::nullopt;
+		}
+
+		uint32_t end;
+		if(__builtin_add_overflow(flash_offset, length, &end)) {
+			sysctrl::nak(ErrorCode::OutOfRange, 2);
+			return std::nullopt;
+		}
+
+		if((flash_offset & 0xFFU) != 0) {
+			sysctrl::nak(ErrorCode::NotAligned, 1);
+			return std::nullopt;
+		}
+
+		if((work_offset & 0x3U) != 0) {
+			sysctrl::nak(ErrorCode::NotAligned, 2);
+			return std::nullopt;
+		}
+
+		if((length & 0xFFU) != 0) {
+			sysctrl::nak(ErrorCode::NotAligned, 3);
+			return std::nullopt;
+		}
+
+		auto const first_sector = sector_table::find(flash_offset);
+		auto const last_sector = sector_table::find(end - 1);
+
+		if(not first_sector or not last_sector) {
+			sysctrl::nak(ErrorCode::OutOfRange, 3);
+			return std::nullopt;
+		}
+
+		return SectorRange { *first_sector, *last_sector };
 	}
 
-	sysctrl::state rcv(sysctrl::state state, uint8_t val)
+	//! Copies the work buffer range to the already erased flash.
+	bool program(uint32_t flash_offset, uint32_t work_offset, uint32_t length)
 	{
-		switch(State(state))
+		// The IAP locks the sectors again after every copy, so each block
+		// needs its own prepare.
+		uint32_t offset = 0;
+		while(offset < length)
 		{
-			case ReadFlashOffset0:
-				flash_offset = val;
-				return ReadFlashOffset1;
-
-			case ReadFlashOffset1:
-				flash_offset |= uint32_t(val) << 8;
-				return ReadLength0;
-
-			case ReadFlashOffset2:
-				flash_offset |= uint32_t(val) << 16;
-				return ReadLength0;
-
-			case ReadFlashOffset3:
-				flash_offset |= uint32_t(val) << 24;
-				return ReadWorkOffset0;
-
-			case ReadWorkOffset0:
-				work_offset = val;
-				return ReadWorkOffset1;
-
-			case ReadWorkOffset1:
-				work_offset |= uint16_t(val) << 8;
-				return ReadLength0;
-
-			case ReadLength0:
-				length = val;
-				return ReadLength1;
-
-			case ReadLength1:
-				length |= uint16_t(val) << 8;
-				if(length > 0) {
-					if(uint32_t(work_offset) + length > sizeof(ahbram))
-						return sysctrl::return_to_main(ErrorCode::OutOfRange, 1);
-
-					uint32_t end;
-					if(__builtin_add_overflow(flash_offset, uint32_t(length), &end))
-						return sysctrl::return_to_main(ErrorCode::OutOfRange, 2);
-
-					if((flash_offset & 0xFFU) != 0)
-						return sysctrl::return_to_main(ErrorCode::NotAligned, 1);
-
-					if((work_offset & 0x3U) != 0)
-						return sysctrl::return_to_main(ErrorCode::NotAligned, 2);
-
-					if((length & 0xFFU) != 0)
-						return sysctrl::return_to_main(ErrorCode::NotAligned, 3);
-
-					uint32_t end_address = (flash_offset + length + 0xFFU - 1) & ~0xFFU;
-
-					auto const first_sector = find_sector_for_address(flash_offset);
-					auto const last_sector = find_sector_for_address(end_address);
-
-					if(not first_sector or not last_sector)
-						return sysctrl::return_to_main(ErrorCode::OutOfRange, 3);
-
-					auto const prep1_err = iap::prepare_sector(*first_sector, *last_sector);
-					if(prep1_err != iap::CMD_SUCCESS)
-						return sysctrl::return_to_main(ErrorCode::IAPFailure, 1);
-
-					auto const erase_err = iap::erase_sectors(*first_sector, *last_sector, F_CPU / 1000);
-					if(erase_err != iap::CMD_SUCCESS)
-						return sysctrl::return_to_main(ErrorCode::IAPFailure, 2);
-
-					uint32_t offset = 0;
-					while(offset < length)
-					{
-						auto len = std::min<uint32_t>(4096, uint32_t(length) - offset);
-						if(len < 512)
-							len = 256;
-						else if(len < 1024)
-							len = 512;
-						else if(len < 4096)
-							len = 1024;
-
-						auto const first_sector = find_sector_for_address(flash_offset + offset);
-						auto const last_sector = find_sector_for_address(flash_offset + offset + len - 1);
-
-						if(not first_sector or not last_sector)
-							return sysctrl::return_to_main(ErrorCode::OutOfRange, 4);
-
-						auto const prep2_err = iap::prepare_sector(*first_sector, *last_sector);
-						if(prep2_err != iap::CMD_SUCCESS)
-							return sysctrl::return_to_main(ErrorCode::IAPFailure, 3);
-
-
-						auto const copy_error = iap::copy_ram_to_flash(
-							reinterpret_cast<uint32_t*>(flash_offset + offset),
-							reinterpret_cast<uint32_t*>(work_offset + offset),
-							len,
-							F_CPU / 1000
-						);
-						if(copy_error != iap::CMD_SUCCESS)
-							return sysctrl::return_to_main(ErrorCode::IAPFailure, 5);
-
-						offset += len;
-					}
-
-					return sysctrl::return_to_main();
-				}
-				else {
-					return sysctrl::return_to_main(ErrorCode::InvalidLength);
-				}
+			uint32_t contiguous;
+			uint8_t * const source = workbuf::address(work_offset + offset, contiguous);
+
+			// a block must not cross the border between two work buffer regions
+			uint32_t const remaining = length - offset;
+			if(contiguous < 256) {
+				sysctrl::nak(ErrorCode::NotAligned, 4);
+				return false;
+			}
+
+			uint32_t const len = block_size((remaining < contiguous) ? remaining : contiguous);
+			uint32_t const address = flash_offset + offset;
+
+			auto const prep_err = iap::prepare_sector(
+				sector_table::index_of(address),
+				sector_table::index_of(address + len - 1)
+			);
+			if(prep_err != iap::CMD_SUCCESS) {
+				sysctrl::nak(ErrorCode::IAPFailure, 3);
+				return false;
+			}
+
+			auto const copy_error = iap::copy_ram_to_flash(
+				reinterpret_cast<uint32_t*>(address),
+				reinterpret_cast<uint32_t*>(source),
+				len,
+				sysclock::cclk() / 1000
+			);
+			if(copy_error != iap::CMD_SUCCESS) {
+				sysctrl::nak(ErrorCode::IAPFailure, 5);
+				return false;
+			}
+
+			offset += len;
 		}
-		return sysctrl::return_to_main(ErrorCode::UnknownState);
+		return true;
 	}
 }
 
-sysctrl::state erase_and_write::begin()
+template<typename T>
+void erase_and_write::execute(uint32_t flash_offset, T work_offset, T length)
 {
-	return sysctrl::go(&rcv, ReadFlashOffset0);
+	auto const sectors = check(flash_offset, work_offset, length);
+	if(not sectors)
+		return;
+
+	auto const prep1_err = iap::prepare_sector(sectors->first, sectors->last);
+	if(prep1_err != iap::CMD_SUCCESS)
+		return sysctrl::nak(ErrorCode::IAPFailure, 1);
+
+	auto const erase_err = iap::erase_sectors(sectors->first, sectors->last, sysclock::cclk() / 1000);
+	if(erase_err != iap::CMD_SUCCESS)
+		return sysctrl::nak(ErrorCode::IAPFailure, 2);
+
+	if(program(flash_offset, work_offset, length))
+		sysctrl::acknowledge();
+}
+
+void erase_and_write::program_only(uint32_t flash_offset, uint32_t work_offset, uint32_t length)
+{
+	auto const sectors = check(flash_offset, work_offset, length);
+	if(not sectors)
+		return;
+
+	if(program(flash_offset, work_offset, length))
+		sysctrl::acknowledge();
+}
+
+void erase_and_write::program_list(uint8_t count)
+{
+	if(count == 0)
+		return sysctrl::nak(ErrorCode::InvalidLength);
+
+	// no valid list is longer, so there is nothing to drain (see packet::discard)
+	if(count > max_extents)
+		return sysctrl::nak(ErrorCode::OutOfRange);
+
+	// receive the whole list first, the UART would overrun
+	// while the IAP is programming
+	struct Extent
+	{
+		uint32_t flash_offset, work_offset, length;
+	};
+	Extent extents[max_extents];
+	for(size_t i = 0; i < count; i++)
+	{
+		extents[i].flash_offset = packet::read<uint32_t>();
+		extents[i].work_offset = packet::read<uint32_t>();
+		extents[i].length = packet::read<uint32_t>();
+	}
+
+	for(size_t i = 0; i < count; i++)
+	{
+		auto const & extent = extents[i];
+		auto const sectors = check(extent.flash_offset, extent.work_offset, extent.length);
+		if(not sectors)
+			return;
+		if(not program(extent.flash_offset, extent.work_offset, extent.length))
+			return;
+	}
+
+	sysctrl::acknowledge();
 }
+
+template void erase_and_write::execute<uint16_t>(uint32_t, uint16_t, uint16_t);
+template void erase_and_write::execute<uint32_t>(uint32_t, uint32_t, uint32_t);
@@ -5,7 +5,22 @@
 
 namespace erase_and_write
 {
-	sysctrl::state begin();
+	//! W uses u16 work offset and length, w (protocol v2) u32 fields.
+	template<typename T>
+	void execute(uint32_t flash_offset, T work_offset, T length);
+
+	extern template void execute<uint16_t>(uint32_t, uint16_t, uint16_t);
+	extern template void execute<uint32_t>(uint32_t, uint32_t, uint32_t);
+
+	//! p: writes to already erased sectors without erasing them first.
+	void program_only(uint32_t flash_offset, uint32_t work_offset, uint32_t length);
+
+	//! Maximum number of extents of a single P command.
+	static constexpr uint8_t max_extents = 32;
+
+	//! P: like p for a list of { flash_offset:u32, work_offset:u32, length:u32 }.
+	//! Flash between the extents is left untouched.
+	void program_list(uint8_t count);
 }
 
 #endif // ERASE_AND_WRITE_HPP
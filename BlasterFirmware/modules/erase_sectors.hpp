@@ -5,8 +5,8 @@
 
 namespace erase_sectors
 {
-	sysctrl::state begin_partial();
-	sysctrl::state begin_full();
+	void execute_partial(uint8_t sectorCount);
+	void execute_full();
 };
 
 #endif // ERASE_SECTORS_HPP
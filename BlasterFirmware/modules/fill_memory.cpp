@@ -0,0 +1,44 @@
+#include "fill_memory.hpp"
+
+#include "sysctrl.hpp"
+
+#include <cstring>
+
+namespace
+{
+	void fill(uint32_t offset, uint32_t length, uint32_t pattern)
+	{
+		if(length == 0)
+			return sysctrl::nak(ErrorCode::InvalidLength);
+
+		if(not workbuf::contains(offset, length))
+			return sysctrl::nak(ErrorCode::OutOfRange);
+
+		bool const single_byte = (pattern == (pattern & 0xFFU) * 0x01010101U);
+
+		uint32_t position = 0;
+		workbuf::for_each(offset, length, [&](uint8_t * ptr, uint32_t len) {
+			if(single_byte) {
+				memset(ptr, int(pattern & 0xFFU), len);
+				return;
+			}
+			for(uint32_t i = 0; i < len; i++, position++)
+				ptr[i] = uint8_t(pattern >> (8 * (position & 3U)));
+		});
+		sysctrl::acknowledge();
+	}
+}
+
+template<typename T>
+void fill_memory::zero(T offset, T length)
+{
+	fill(offset, length, 0);
+}
+
+void fill_memory::execute(uint32_t offset, uint32_t length, uint32_t pattern)
+{
+	fill(offset, length, pattern);
+}
+
+template void fill_memory::zero<uint16_t>(uint16_t, uint16_t);
+template void fill_memory::zero<uint32_t>(uint32_t, uint32_t);
@@ -0,0 +1,19 @@
+#ifndef FILL_MEMORY_HPP
+#define FILL_MEMORY_HPP
+
+#include "sysctrl.hpp"
+
+namespace fill_memory
+{
+	//! Z uses u16 fields, z (protocol v2) u32 fields.
+	template<typename T>
+	void zero(T offset, T length);
+
+	extern template void zero<uint16_t>(uint16_t, uint16_t);
+	extern template void zero<uint32_t>(uint32_t, uint32_t);
+
+	//! f: repeats the little endian `pattern` starting at `offset`.
+	void execute(uint32_t offset, uint32_t length, uint32_t pattern);
+}
+
+#endif // FILL_MEMORY_HPP
@@ -0,0 +1,18 @@
+#include "flash_layout.hpp"
+#include "sector_table.hpp"
+#include "identity.hpp"
+#include "packet.hpp"
+#include "serial.hpp"
+
+void flash_layout::execute()
+{
+	sysctrl::acknowledge();
+	packet::write<uint32_t>(identity::part_id());
+	Serial::tx(char(sector_table::count()));
+	for(uint32_t i = 0; i < sector_table::count(); i++)
+	{
+		auto const sector = sector_table::sector(i);
+		packet::write<uint32_t>(sector.start_address);
+		packet::write<uint32_t>(sector.length);
+	}
+}
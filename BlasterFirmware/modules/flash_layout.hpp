@@ -0,0 +1,11 @@
+#ifndef FLASH_LAYOUT_HPP
+#define FLASH_LAYOUT_HPP
+
+#include "sysctrl.hpp"
+
+namespace flash_layout
+{
+	void execute();
+}
+
+#endif // FLASH_LAYOUT_HPP
@@ -0,0 +1,21 @@
+#include "hash_sectors.hpp"
+#include "sector_table.hpp"
+#include "crc32.hpp"
+#include "packet.hpp"
+#include "serial.hpp"
+
+void hash_sectors::execute(uint8_t first, uint8_t count)
+{
+	if(count == 0)
+		return sysctrl::nak(ErrorCode::InvalidLength);
+
+	if(uint32_t(first) + count > sector_table::count())
+		return sysctrl::nak(ErrorCode::OutOfRange);
+
+	sysctrl::acknowledge();
+	for(uint32_t i = first; i < uint32_t(first) + count; i++)
+	{
+		auto const sector = sector_table::sector(i);
+		packet::write<uint32_t>(crc32::compute_fast(reinterpret_cast<void const *>(sector.start_address), sector.length));
+	}
+}
@@ -0,0 +1,12 @@
+#ifndef HASH_SECTORS_HPP
+#define HASH_SECTORS_HPP
+
+#include "sysctrl.hpp"
+
+namespace hash_sectors
+{
+	//! H: sends the CRC-32 of each sector in [first, first+count).
+	void execute(uint8_t first, uint8_t count);
+}
+
+#endif // HASH_SECTORS_HPP
@@ -0,0 +1,15 @@
+#include "memory_map.hpp"
+#include "packet.hpp"
+#include "serial.hpp"
+
+void memory_map::execute()
+{
+	sysctrl::acknowledge();
+	Serial::tx(char(workbuf::region_count()));
+	for(size_t i = 0; i < workbuf::region_count(); i++)
+	{
+		auto const & region = workbuf::region(i);
+		packet::write<uint32_t>(reinterpret_cast<uintptr_t>(region.start));
+		packet::write<uint32_t>(region.length);
+	}
+}
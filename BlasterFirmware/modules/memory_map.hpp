@@ -0,0 +1,11 @@
+#ifndef MEMORY_MAP_HPP
+#define MEMORY_MAP_HPP
+
+#include "sysctrl.hpp"
+
+namespace memory_map
+{
+	void execute();
+}
+
+#endif // MEMORY_MAP_HPP
@@ -3,9 +3,15 @@
 
 #include "system_main.hpp"
 #include "data_loader.hpp"
-#include "zero_memory.hpp"
+#include "fill_memory.hpp"
 #include "readback_memory.hpp"
 #include "erase_sectors.hpp"
 #include "erase_and_write.hpp"
+#include "version_info.hpp"
+#include "memory_map.hpp"
+#include "flash_layout.hpp"
+#include "device_info.hpp"
+#include "copy_flash.hpp"
+#include "hash_sectors.hpp"
 
 #endif // MODULES_HPP
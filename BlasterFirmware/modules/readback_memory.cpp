@@ -1,89 +1,91 @@
 #include "readback_memory.hpp"
+#include "protocol.hpp"
+#include "packet.hpp"
 #include "serial.hpp"
 
 namespace
 {
-	enum State {
-		ReadOffset0 = 0,
-		ReadOffset1,
-		ReadOffset2,
-		ReadOffset3,
-		ReadLength0,
-		ReadLength1,
-		ReadLength2,
-		ReadLength3,
-	};
-
-	uint32_t offset;
-	uint32_t length;
-
-	sysctrl::state rcv(sysctrl::state state, uint8_t val)
+	//! Run length encodes `src` and passes each encoded byte to `emit`.
+	template<typename Emit>
+	void rle_encode(uint8_t const * src, uint32_t length, Emit && emit)
 	{
-		switch(State(state))
-		{
-			case ReadOffset0:
-				offset = val;
-				return ReadOffset1;
+		uint32_t literals = 0; // start of the pending literal bytes
 
-			case ReadOffset1:
-				offset |= uint32_t(val) << 8;
-				return ReadOffset2;
+		auto const flush = [&](uint32_t end)
+		{
+			while(literals < end)
+			{
+				uint32_t const count = (end - literals < 128) ? (end - literals) : 128;
+				emit(uint8_t(count - 1));
+				for(uint32_t i = 0; i < count; i++)
+					emit(src[literals + i]);
+				literals += count;
+			}
+		};
+
+		uint32_t i = 0;
+		while(i < length)
+		{
+			uint32_t run = 1;
+			while(i + run < length and run < 130 and src[i + run] == src[i])
+				run += 1;
+
+			if(run >= 3) {
+				flush(i);
+				emit(uint8_t(0x80 | (run - 3)));
+				emit(src[i]);
+				literals = i + run;
+			}
+			i += run;
+		}
+		flush(length);
+	}
+}
 
-			case ReadOffset2:
-				offset |= uint32_t(val) << 16;
-				return ReadOffset3;
+void readback_memory::execute(uint32_t offset, uint32_t length)
+{
+	if(length == 0)
+		return sysctrl::nak(ErrorCode::InvalidLength);
 
-			case ReadOffset3:
-				offset |= uint32_t(val) << 24;
-				return ReadLength0;
+	uint32_t end;
+	if(__builtin_add_overflow(offset, length, &end))
+		return sysctrl::nak(ErrorCode::OutOfRange);
 
-			case ReadLength0:
-				length = val;
-				return ReadLength1;
+	sysctrl::acknowledge();
 
-			case ReadLength1:
-				length |= uint32_t(val) << 8;
-				return ReadLength2;
+	uint16_t const checksum = Serial::tx(reinterpret_cast<void const *>(offset), length);
 
-			case ReadLength2:
-				length |= uint32_t(val) << 16;
-				return ReadLength3;
+	Serial::tx(checksum & 0xFFU);
+	Serial::tx((checksum & 0xFF00U) >> 8);
+}
 
-			case ReadLength3:
-				length |= uint32_t(val) << 24;
-				if(length > 0) {
-					uint32_t end;
-					if(__builtin_add_overflow(offset, length, &end))
-						return sysctrl::return_to_main(ErrorCode::OutOfRange);
+void readback_memory::execute_compressed(uint32_t offset, uint32_t length)
+{
+	if(length == 0)
+		return sysctrl::nak(ErrorCode::InvalidLength);
 
-					sysctrl::acknowledge();
+	uint32_t end;
+	if(__builtin_add_overflow(offset, length, &end))
+		return sysctrl::nak(ErrorCode::OutOfRange);
 
-					uint8_t const * memory = reinterpret_cast<uint8_t const *>(offset);
+	sysctrl::acknowledge();
 
-					uint16_t checksum = 0;
-					for(size_t i = 0; i < length; i++) {
-						uint8_t b = memory[i];
-						checksum += b;
-						Serial::tx(b);
-					}
+	while(offset < end)
+	{
+		uint32_t const block = (end - offset < readback_block_size) ? (end - offset) : readback_block_size;
+		uint8_t const * const src = reinterpret_cast<uint8_t const *>(offset);
 
-					Serial::tx(checksum & 0xFFU);
-					Serial::tx((checksum & 0xFF00U) >> 8);
+		// the length goes first, so encode twice instead of buffering
+		uint16_t encoded_length = 0;
+		rle_encode(src, block, [&](uint8_t) { encoded_length += 1; });
+		packet::write<uint16_t>(encoded_length);
 
-					return sysctrl::return_to_main(true);
-				}
-				else {
-					return sysctrl::return_to_main(ErrorCode::InvalidLength);
-				}
+		uint16_t checksum = 0;
+		rle_encode(src, block, [](uint8_t value) { Serial::tx(char(value)); });
+		for(uint32_t i = 0; i < block; i++)
+			checksum += src[i];
+		packet::write<uint16_t>(checksum);
 
-		}
-		return sysctrl::return_to_main(ErrorCode::UnknownState);
+		offset += block;
 	}
 }
-
-sysctrl::state readback_memory::begin()
-{
-	offset = 0;
-	length = 0;
-	return sysctrl::go(&rcv, ReadOffset0);
-}
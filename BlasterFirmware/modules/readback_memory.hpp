@@ -5,7 +5,13 @@
 
 namespace readback_memory
 {
-	sysctrl::state begin();
+	void execute(uint32_t offset, uint32_t length);
+
+	//! r: sends the memory in blocks of readback_block_size bytes, each as
+	//! { encoded_length:u16, data:u8[encoded_length], checksum:u16 }.
+	//! `data` uses the run length encoding of the u command (see
+	//! data_loader.hpp), `checksum` is the sum of the decoded bytes.
+	void execute_compressed(uint32_t offset, uint32_t length);
 }
 
 #endif // READBACK_MEMORY_HPP
@@ -1,28 +1,38 @@
 #include "system_main.hpp"
 #include "modules.hpp"
 #include "sysctrl.hpp"
-#include "serial.hpp"
+#include "packet.hpp"
 #include <hal/iap.hpp>
 
 #include <lpc17xx.h>
 
-static sysctrl::state rcv(sysctrl::state, uint8_t c)
+void system_main::dispatch(uint8_t c)
 {
 	switch(c)
 	{
-		case 'L': return data_loader::begin();
-		case 'Z': return zero_memory::begin();
-		case 'R': return readback_memory::begin();
-		case 'E': return erase_sectors::begin_partial();
-		case 'F': return erase_sectors::begin_full();
+		case 'L': return packet::invoke(data_loader::execute<uint16_t>);
+		case 'Z': return packet::invoke(fill_memory::zero<uint16_t>);
+		case 'R': return packet::invoke(readback_memory::execute);
+		case 'E': return packet::invoke(erase_sectors::execute_partial);
+		case 'F': return packet::invoke(erase_sectors::execute_full);
+		case 'W': return packet::invoke(erase_and_write::execute<uint16_t>);
+		case 'V': return packet::invoke(version_info::execute);
+		case 'l': return packet::invoke(data_loader::execute<uint32_t>);
+		case 'z': return packet::invoke(fill_memory::zero<uint32_t>);
+		case 'w': return packet::invoke(erase_and_write::execute<uint32_t>);
+		case 'M': return packet::invoke(memory_map::execute);
+		case 'p': return packet::invoke(erase_and_write::program_only);
+		case 'f': return packet::invoke(fill_memory::execute);
+		case 'u': return packet::invoke(data_loader::execute_rle);
+		case 'P': return packet::invoke(erase_and_write::program_list);
+		case 'r': return packet::invoke(readback_memory::execute_compressed);
+		case 'T': return packet::invoke(flash_layout::execute);
+		case 'I': return packet::invoke(device_info::execute);
+		case 'C': return packet::invoke(copy_flash::execute);
+		case 'H': return packet::invoke(hash_sectors::execute);
+		case 'D': return packet::invoke(data_loader::execute_fec);
 		case 'K': NVIC_SystemReset(); break;
 		case 'X': iap::reinvoke_isp(); break;
-		default: return sysctrl::return_to_main(ErrorCode::UnknownCommand, c);
+		default: return sysctrl::nak(ErrorCode::UnknownCommand, c);
 	}
-	return 0;
-}
-
-sysctrl::state system_main::begin()
-{
-	return sysctrl::go(&rcv, 0);
 }
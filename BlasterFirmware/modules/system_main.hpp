@@ -12,6 +12,51 @@
 // W:erase_and_write(flash_offset:u32,work_offset:u16,length:u16)
 // K:[[noreturn]] reset_system()
 // X:[[noreturn]] exit_to_isp()
+// V:version() → { protocol:u8, features:u32 }
+//
+// protocol v2 (Feature::WideCommands):
+// l:load_memory(offset:u32, length:u32, data:u8[length], checksum:u16)
+// z:zero_memory(offset:u32, length:u32)
+// w:erase_and_write(flash_offset:u32,work_offset:u32,length:u32)
+//
+// Feature::MemoryMap:
+// M:memory_map() → { count:u8, regions:{ start:u32, length:u32 }[count] }
+//
+// Feature::ProgramOnly:
+// p:program(flash_offset:u32,work_offset:u32,length:u32)
+//
+// Feature::FillAndRLE:
+// f:fill_memory(offset:u32, length:u32, pattern:u32)
+// u:load_rle(offset:u32, length:u32, encoded_length:u32, data:u8[encoded_length], checksum:u16)
+//
+// Feature::SparseProgram:
+// P:program_list(count:u8, extents:{ flash_offset:u32, work_offset:u32, length:u32 }[count])
+//
+// Feature::CompressedReadback:
+// r:readback_compressed(offset:u32, length:u32) → { encoded_length:u16, data:u8[encoded_length], checksum:u16 }[blocks]
+//
+// Feature::FlashLayout:
+// T:flash_layout() → { part_id:u32, count:u8, sectors:{ start:u32, length:u32 }[count] }
+//
+// Feature::DeviceInfo:
+// I:device_info() → { protocol:u8, features:u32, part_id:u32, boot_version:u32, serial:u32[4],
+//                     cclk:u32, baudrate:u32, flash_size:u32, work_size:u32,
+//                     count:u8, regions:{ start:u32, length:u32 }[count] }
+//
+// Feature::CopyFlash:
+// C:copy_flash(flash_offset:u32, work_offset:u32, length:u32)
+//
+// Feature::SectorHashes:
+// H:hash_sectors(first:u8, count:u8) → { crc32:u32[count] }
+//
+// Feature::Pipelining:
+// no command, the host may send up to receive_buffer_size bytes behind a
+// command that stops reading (see protocol.hpp)
+//
+// Feature::ForwardErrorCorrection:
+// D:load_fec(offset:u32, length:u32, parity:u8, header_parity:u8[8],
+//            { data:u8[≤255-parity], check:u8[parity] }[blocks])
+//   → { corrected:u16, crc32:u32, count:u16, lost:u16[count] }
 
 // every command either returns
 //   ACK ('\006')
@@ -21,7 +66,8 @@
 
 namespace system_main
 {
-	sysctrl::state begin();
+	//! Receives the header of the given command and executes it.
+	void dispatch(uint8_t command);
 }
 
 #endif // SYSTEM_MAIN_HPP
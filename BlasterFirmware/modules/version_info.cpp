@@ -0,0 +1,24 @@
+#include "version_info.hpp"
+#include "protocol.hpp"
+#include "packet.hpp"
+#include "serial.hpp"
+
+uint32_t const version_info::features = Feature::WideCommands
+	| Feature::MemoryMap
+	| Feature::ProgramOnly
+	| Feature::FillAndRLE
+	| Feature::SparseProgram
+	| Feature::CompressedReadback
+	| Feature::FlashLayout
+	| Feature::DeviceInfo
+	| Feature::CopyFlash
+	| Feature::SectorHashes
+	| Feature::Pipelining
+	| Feature::ForwardErrorCorrection;
+
+void version_info::execute()
+{
+	sysctrl::acknowledge();
+	Serial::tx(protocol_version);
+	packet::write<uint32_t>(features);
+}
@@ -0,0 +1,15 @@
+#ifndef VERSION_INFO_HPP
+#define VERSION_INFO_HPP
+
+#include "sysctrl.hpp"
+#include "protocol.hpp"
+
+namespace version_info
+{
+	//! Features of this firmware, see protocol.hpp.
+	extern uint32_t const features;
+
+	void execute();
+}
+
+#endif // VERSION_INFO_HPP
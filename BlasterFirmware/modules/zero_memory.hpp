@@ -1,11 +0,0 @@
-#ifndef ZERO_MEMORY_HPP
-#define ZERO_MEMORY_HPP
-
-#include "sysctrl.hpp"
-
-namespace zero_memory
-{
-	sysctrl::state begin();
-}
-
-#endif // ZERO_MEMORY_HPP
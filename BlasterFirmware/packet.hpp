@@ -0,0 +1,62 @@
+#ifndef PACKET_HPP
+#define PACKET_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+
+#include "serial.hpp"
+
+namespace packet
+{
+	//! Receives a little endian integer from the serial port.
+	template<typename T>
+	T read()
+	{
+		static_assert(std::is_integral_v<T> and std::is_unsigned_v<T>);
+		uint8_t bytes[sizeof(T)];
+		Serial::rx(bytes, sizeof bytes);
+		T value = 0;
+		for(size_t i = 0; i < sizeof(T); i++)
+			value |= T(bytes[i]) << (8 * i);
+		return value;
+	}
+
+	//! Sends a little endian integer to the serial port.
+	template<typename T>
+	void write(T value)
+	{
+		static_assert(std::is_integral_v<T> and std::is_unsigned_v<T>);
+		uint8_t bytes[sizeof(T)];
+		for(size_t i = 0; i < sizeof(T); i++)
+			bytes[i] = uint8_t(value >> (8 * i));
+		Serial::tx(bytes, sizeof bytes);
+	}
+
+	//! Drops the `length` payload bytes and the `trailer` (checksum, check
+	//! bytes) of a rejected command, so the next command is read from the
+	//! right place. A length above `limit`, the largest a valid packet has,
+	//! is not drained: its header was completed by the 0xFF filler the host
+	//! sends to resynchronize, and draining it would swallow the commands
+	//! behind the filler.
+	inline void discard(uint32_t length, uint32_t limit, uint32_t trailer = 0)
+	{
+		if(length <= limit)
+			Serial::skip(size_t(length) + trailer);
+	}
+
+	//! Receives the fixed header of a command and passes it to the handler.
+	//! The header layout is given by the parameter list of the handler, so
+	//! `void handler(uint32_t offset, uint16_t length)` reads a u32 followed
+	//! by a u16.
+	template<typename... Fields>
+	void invoke(void (*handler)(Fields...))
+	{
+		// braced initialization guarantees left-to-right evaluation
+		std::tuple<Fields...> header { read<Fields>()... };
+		std::apply(handler, header);
+	}
+}
+
+#endif // PACKET_HPP
@@ -0,0 +1,65 @@
+#ifndef PROTOCOL_HPP
+#define PROTOCOL_HPP
+
+#include <cstdint>
+
+//! Version of the LPCBlaster protocol, reported by the V command.
+//! Firmware without the V command implements protocol version 1.
+static constexpr uint8_t protocol_version = 2;
+
+//! Optional features, reported as a bit mask by the V command.
+enum class Feature : uint32_t
+{
+	WideCommands       = (1U << 0), // l, z, w with 32 bit offsets and lengths
+	MemoryMap          = (1U << 1), // M, work buffer larger than 32k
+	ProgramOnly        = (1U << 2), // p, write without erasing
+	FillAndRLE         = (1U << 3), // f and u, pattern fill and run length encoded load
+	SparseProgram      = (1U << 4), // P, write a list of extents without erasing
+	CompressedReadback = (1U << 5), // r, run length encoded readback
+	FlashLayout        = (1U << 6), // T, part ID and sector table of the running part
+	DeviceInfo         = (1U << 7), // I, all device information in one reply
+	CopyFlash          = (1U << 8), // C, copy flash to the work buffer
+	SectorHashes       = (1U << 9), // H, CRC-32 of sectors
+	Pipelining         = (1U << 10), // receive buffer of receive_buffer_size bytes
+	ForwardErrorCorrection = (1U << 11), // D, Reed-Solomon protected load
+};
+
+//! Number of bytes in each block of the r command (the last may be shorter).
+static constexpr uint32_t readback_block_size = 4096;
+
+//! Size of the receive buffer of the blaster with Feature::Pipelining.
+//! While a command that stops reading (erase, write, readback, …) runs,
+//! the host may send up to this many bytes of following commands.
+static constexpr uint32_t receive_buffer_size = 2048;
+
+//! Reed-Solomon check bytes behind the header of the D command.
+static constexpr uint32_t fec_header_parity = 8;
+
+//! Largest number of check bytes per D block the blaster accepts.
+static constexpr uint32_t fec_max_parity = 32;
+
+//! Largest number of uncorrectable blocks a D reply lists. With more, the
+//! blaster answers Invalid Checksum and the host sends the whole load again.
+static constexpr uint32_t fec_max_lost = 64;
+
+//! Info of the Invalid Checksum NAK of D if the header could not be
+//! corrected. The blaster took the rest of the packet for commands, the
+//! host has to resynchronize.
+static constexpr uint8_t fec_header_lost = 1;
+
+static constexpr uint32_t operator|(Feature a, Feature b)
+{
+	return uint32_t(a) | uint32_t(b);
+}
+
+static constexpr uint32_t operator|(uint32_t a, Feature b)
+{
+	return a | uint32_t(b);
+}
+
+static constexpr bool has_feature(uint32_t features, Feature f)
+{
+	return (features & uint32_t(f)) != 0;
+}
+
+#endif // PROTOCOL_HPP
@@ -0,0 +1,202 @@
+#ifndef REED_SOLOMON_HPP
+#define REED_SOLOMON_HPP
+
+#include <cstdint>
+#include <cstddef>
+
+//! Reed-Solomon code over GF(2^8) (polynomial 0x11D, generator roots
+//! α^0 … α^(parity-1)), shared by firmware and host. A block is up to 255
+//! bytes: the data followed by `parity` check bytes. Blocks shorter than
+//! 255 bytes are shortened codes, the missing leading bytes count as zero.
+//! Up to parity/2 wrong bytes per block are corrected.
+namespace reed_solomon
+{
+	static constexpr size_t max_block = 255;
+	static constexpr size_t max_parity = 32;
+
+	struct Tables
+	{
+		uint8_t exp[512];
+		uint8_t log[256];
+	};
+
+	constexpr Tables make_tables()
+	{
+		Tables tables { };
+		unsigned x = 1;
+		for(unsigned i = 0; i < 255; i++)
+		{
+			tables.exp[i] = uint8_t(x);
+			tables.log[x] = uint8_t(i);
+			x <<= 1;
+			if(x & 0x100)
+				x ^= 0x11D;
+		}
+		// doubled, so products of logarithms need no modulo
+		for(unsigned i = 255; i < 512; i++)
+			tables.exp[i] = tables.exp[i - 255];
+		return tables;
+	}
+
+	static constexpr Tables tables = make_tables();
+
+	inline uint8_t mul(uint8_t a, uint8_t b)
+	{
+		if(a == 0 or b == 0)
+			return 0;
+		return tables.exp[tables.log[a] + tables.log[b]];
+	}
+
+	//! `b` must not be zero.
+	inline uint8_t div(uint8_t a, uint8_t b)
+	{
+		if(a == 0)
+			return 0;
+		return tables.exp[tables.log[a] + 255 - tables.log[b]];
+	}
+
+	//! α^power for 0 ≤ power < 510.
+	inline uint8_t alpha(unsigned power)
+	{
+		return tables.exp[power];
+	}
+
+	//! Computes the `parity_length` check bytes of `length` data bytes.
+	inline void encode(uint8_t const * data, size_t length, uint8_t * parity, size_t parity_length)
+	{
+		// generator polynomial, highest degree first
+		uint8_t generator[max_parity + 1] = { 1 };
+		for(size_t i = 0; i < parity_length; i++)
+		{
+			generator[i + 1] = 0;
+			for(size_t j = i + 1; j > 0; j--)
+				generator[j] ^= mul(generator[j - 1], alpha(unsigned(i)));
+		}
+
+		// remainder of data(x)·x^parity_length divided by the generator
+		for(size_t i = 0; i < parity_length; i++)
+			parity[i] = 0;
+		for(size_t i = 0; i < length; i++)
+		{
+			uint8_t const feedback = data[i] ^ parity[0];
+			for(size_t j = 0; j + 1 < parity_length; j++)
+				parity[j] = parity[j + 1] ^ mul(generator[j + 1], feedback);
+			parity[parity_length - 1] = mul(generator[parity_length], feedback);
+		}
+	}
+
+	//! Corrects `block` (data followed by `parity_length` check bytes) in
+	//! place. Returns the number of corrected bytes or -1 if the block has
+	//! more errors than the code can correct.
+	inline int decode(uint8_t * block, size_t length, size_t parity_length)
+	{
+		// syndromes, the block evaluated at the roots of the generator
+		uint8_t syndromes[max_parity];
+		bool clean = true;
+		for(size_t i = 0; i < parity_length; i++)
+		{
+			uint8_t const root = alpha(unsigned(i));
+			uint8_t s = 0;
+			for(size_t j = 0; j < length; j++)
+				s = mul(s, root) ^ block[j];
+			syndromes[i] = s;
+			clean &= (s == 0);
+		}
+		if(clean)
+			return 0;
+
+		// Berlekamp-Massey: error locator Λ(x), lowest degree first
+		uint8_t locator[max_parity + 1] = { 1 };
+		uint8_t previous[max_parity + 1] = { 1 };
+		size_t errors = 0;
+		size_t shift = 1;
+		uint8_t previous_discrepancy = 1;
+		for(size_t n = 0; n < parity_length; n++)
+		{
+			uint8_t discrepancy = syndromes[n];
+			for(size_t i = 1; i <= errors; i++)
+				discrepancy ^= mul(locator[i], syndromes[n - i]);
+
+			if(discrepancy == 0) {
+				shift += 1;
+				continue;
+			}
+
+			uint8_t const factor = div(discrepancy, previous_discrepancy);
+			if(2 * errors <= n) {
+				uint8_t saved[max_parity + 1];
+				for(size_t i = 0; i <= parity_length; i++)
+					saved[i] = locator[i];
+				for(size_t i = 0; i + shift <= parity_length; i++)
+					locator[i + shift] ^= mul(factor, previous[i]);
+				errors = n + 1 - errors;
+				for(size_t i = 0; i <= parity_length; i++)
+					previous[i] = saved[i];
+				previous_discrepancy = discrepancy;
+				shift = 1;
+			} else {
+				for(size_t i = 0; i + shift <= parity_length; i++)
+					locator[i + shift] ^= mul(factor, previous[i]);
+				shift += 1;
+			}
+		}
+		if(2 * errors > parity_length)
+			return -1;
+
+		// error evaluator Ω(x) = S(x)·Λ(x) mod x^parity_length
+		uint8_t evaluator[max_parity];
+		for(size_t i = 0; i < parity_length; i++)
+		{
+			uint8_t value = 0;
+			for(size_t j = 0; j <= i and j <= errors; j++)
+				value ^= mul(locator[j], syndromes[i - j]);
+			evaluator[i] = value;
+		}
+
+		// Chien search and Forney: byte j has the locator X = α^(length-1-j)
+		// and is wrong if Λ(X⁻¹) = 0, the error is X·Ω(X⁻¹) / Λ'(X⁻¹)
+		size_t found = 0;
+		for(size_t j = 0; j < length; j++)
+		{
+			unsigned const power = unsigned(length - 1 - j);
+			uint8_t const inverse = alpha((255 - power) % 255);
+
+			uint8_t value = 0;
+			uint8_t x = 1;
+			for(size_t i = 0; i <= errors; i++) {
+				value ^= mul(locator[i], x);
+				x = mul(x, inverse);
+			}
+			if(value != 0)
+				continue;
+
+			uint8_t omega = 0;
+			x = 1;
+			for(size_t i = 0; i < parity_length; i++) {
+				omega ^= mul(evaluator[i], x);
+				x = mul(x, inverse);
+			}
+
+			// the formal derivative keeps the odd terms
+			uint8_t derivative = 0;
+			x = 1;
+			uint8_t const inverse_squared = mul(inverse, inverse);
+			for(size_t i = 1; i <= errors; i += 2) {
+				derivative ^= mul(locator[i], x);
+				x = mul(x, inverse_squared);
+			}
+			if(derivative == 0)
+				return -1;
+
+			block[j] ^= mul(alpha(power), div(omega, derivative));
+			found += 1;
+		}
+
+		// roots outside of a shortened block mean too many errors
+		if(found != errors)
+			return -1;
+		return int(found);
+	}
+}
+
+#endif // REED_SOLOMON_HPP
@@ -1,37 +1,64 @@
 #include "sector_table.hpp"
+#include "identity.hpp"
 
-#define SECTOR(_Index, _Size, _Start, _End) Sector { _Start, _Size * 1024 }
+namespace
+{
+	struct Variant
+	{
+		uint32_t part_id;
+		uint32_t flash_size;
+	};
+
+	// UM10360, table "LPC17xx part identification numbers"
+	constexpr Variant variants[] =
+	{
+		{ 0x26113F37, 512 * 1024 }, // LPC1769
+		{ 0x26013F37, 512 * 1024 }, // LPC1768
+		{ 0x26012837, 512 * 1024 }, // LPC1767
+		{ 0x26013F33, 256 * 1024 }, // LPC1766
+		{ 0x26013733, 256 * 1024 }, // LPC1765
+		{ 0x26011922, 128 * 1024 }, // LPC1764
+		{ 0x26012033, 256 * 1024 }, // LPC1763
+		{ 0x25113737, 512 * 1024 }, // LPC1759
+		{ 0x25013F37, 512 * 1024 }, // LPC1758
+		{ 0x25011723, 256 * 1024 }, // LPC1756
+		{ 0x25011722, 128 * 1024 }, // LPC1754
+		{ 0x25001121,  64 * 1024 }, // LPC1752
+		{ 0x25001118,  32 * 1024 }, // LPC1751
+	};
+
+	constexpr uint32_t default_flash_size = 512 * 1024;
+
+	// in .bss, .data is part of the image that stage 0 checks before
+	// it starts a resident blaster, so it must not change at runtime
+	uint32_t current_flash_size;
+	uint32_t current_count;
+}
+
+void sector_table::init()
+{
+	current_flash_size = default_flash_size;
+	for(auto const & variant : variants)
+	{
+		if(variant.part_id == identity::part_id())
+			current_flash_size = variant.flash_size;
+	}
+	current_count = count_for(current_flash_size);
+}
+
+uint32_t sector_table::flash_size()
+{
+	return current_flash_size;
+}
+
+uint32_t sector_table::count()
+{
+	return current_count;
+}
 
-const Sector sector_table[30] =
+std::optional<uint32_t> sector_table::find(uint32_t address)
 {
-	SECTOR(0,   4, 0X00000000, 0X00000FFF),
-	SECTOR(1,   4, 0X00001000, 0X00001FFF),
-	SECTOR(2,   4, 0X00002000, 0X00002FFF),
-	SECTOR(3,   4, 0X00003000, 0X00003FFF),
-	SECTOR(4,   4, 0X00004000, 0X00004FFF),
-	SECTOR(5,   4, 0X00005000, 0X00005FFF),
-	SECTOR(6,   4, 0X00006000, 0X00006FFF),
-	SECTOR(7,   4, 0X00007000, 0X00007FFF),
-	SECTOR(8,   4, 0x00008000, 0X00008FFF),
-	SECTOR(9,   4, 0x00009000, 0X00009FFF),
-	SECTOR(10,  4, 0x0000A000, 0X0000AFFF),
-	SECTOR(11,  4, 0x0000B000, 0X0000BFFF),
-	SECTOR(12,  4, 0x0000C000, 0X0000CFFF),
-	SECTOR(13,  4, 0x0000D000, 0X0000DFFF),
-	SECTOR(14,  4, 0x0000E000, 0X0000EFFF),
-	SECTOR(15,  4, 0x0000F000, 0X0000FFFF),
-	SECTOR(16, 32, 0x00010000, 0x00017FFF),
-	SECTOR(17, 32, 0x00018000, 0x0001FFFF),
-	SECTOR(18, 32, 0x00020000, 0x00027FFF),
-	SECTOR(19, 32, 0x00028000, 0x0002FFFF),
-	SECTOR(20, 32, 0x00030000, 0x00037FFF),
-	SECTOR(21, 32, 0x00038000, 0x0003FFFF),
-  SECTOR(22, 32, 0x00040000, 0x00047FFF),
-	SECTOR(23, 32, 0x00048000, 0x0004FFFF),
-  SECTOR(24, 32, 0x00050000, 0x00057FFF),
-	SECTOR(25, 32, 0x00058000, 0x0005FFFF),
-	SECTOR(26, 32, 0x00060000, 0x00067FFF),
-	SECTOR(27, 32, 0x00068000, 0x0006FFFF),
-	SECTOR(28, 32, 0x00070000, 0x00077FFF),
-	SECTOR(29, 32, 0x00078000, 0x0007FFFF),
-};
+	if(address >= current_flash_size)
+		return std::nullopt;
+	return index_of(address);
+}
@@ -2,6 +2,8 @@
 #define SECTOR_TABLE_HPP
 
 #include <cstdint>
+#include <cstddef>
+#include <optional>
 
 struct Sector
 {
@@ -9,6 +11,64 @@ struct Sector
 	uint32_t length;
 };
 
-extern const Sector sector_table[30];
+//! Flash layout of the running part. All LPC17xx parts share the same
+//! layout, 16 sectors of 4 kB followed by sectors of 32 kB, and only
+//! differ in the flash size. The size is selected by the part ID.
+namespace sector_table
+{
+	static constexpr uint32_t small_sector_size = 4 * 1024;
+	static constexpr uint32_t large_sector_size = 32 * 1024;
+	static constexpr uint32_t small_sector_count = 16;
+	static constexpr uint32_t small_sectors_end = small_sector_count * small_sector_size;
+
+	//! Number of sectors of the largest part (512 kB).
+	static constexpr size_t max_count = small_sector_count + (512 * 1024 - small_sectors_end) / large_sector_size;
+
+	//! Index of the sector that contains `address`, not bounds checked.
+	constexpr uint32_t index_of(uint32_t address)
+	{
+		if(address < small_sectors_end)
+			return address / small_sector_size;
+		return small_sector_count + (address - small_sectors_end) / large_sector_size;
+	}
+
+	constexpr Sector sector(uint32_t index)
+	{
+		if(index < small_sector_count)
+			return Sector { index * small_sector_size, small_sector_size };
+		return Sector { small_sectors_end + (index - small_sector_count) * large_sector_size, large_sector_size };
+	}
+
+	//! Number of sectors of a part with `flash_size` bytes of flash.
+	constexpr uint32_t count_for(uint32_t flash_size)
+	{
+		return index_of(flash_size - 1) + 1;
+	}
+
+	static_assert(count_for(512 * 1024) == max_count);
+	static_assert(count_for(64 * 1024) == 16);
+	static_assert(sector(29).start_address == 0x00078000);
+	static_assert(index_of(0x0000FFFF) == 15 and index_of(0x00010000) == 16);
+
+	//! Selects the flash size by the part ID. Parts that are not known are
+	//! treated as 512 kB parts. Must be called after identity::init() and
+	//! before any other function.
+	void init();
+
+	uint32_t flash_size();
+
+	//! Number of sectors of the running part.
+	uint32_t count();
+
+	//! Index of the sector that contains `address`, if it is inside the flash.
+	std::optional<uint32_t> find(uint32_t address);
+
+	//! First address behind sector `index`.
+	inline uint32_t end_of(uint32_t index)
+	{
+		auto const s = sector(index);
+		return s.start_address + s.length;
+	}
+}
 
 #endif // SECTOR_TABLE_HPP
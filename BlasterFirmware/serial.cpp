@@ -3,6 +3,68 @@
 #include <attributes.h>
 
 #include "system.hpp"
+#include "sysclock.hpp"
+#include "protocol.hpp"
+
+namespace
+{
+	static_assert((receive_buffer_size & (receive_buffer_size - 1)) == 0, "must be a power of two");
+
+	// filled by the UART interrupt, emptied by receive()
+	uint8_t receive_buffer[receive_buffer_size];
+	volatile uint32_t receive_head;
+	volatile uint32_t receive_tail;
+	bool buffered = false;
+
+	// Set by buffer_byte() when the buffer was full and bytes were dropped,
+	// the byte that arrives at gap_index follows the dropped ones.
+	volatile bool dropped = false;
+	volatile uint32_t gap_index;
+
+	// receive() returned the byte behind the gap
+	bool gap_passed = false;
+
+	void buffer_byte(char c)
+	{
+		uint32_t const head = receive_head;
+		uint32_t const next = (head + 1) & (receive_buffer_size - 1);
+		if(next == receive_tail) {
+			// the host sent more than allowed
+			if(not dropped) {
+				gap_index = head;
+				dropped = true;
+			}
+			return;
+		}
+		receive_buffer[head] = uint8_t(c);
+		receive_head = next;
+	}
+
+	bool receive_ready()
+	{
+		if(buffered)
+			return receive_head != receive_tail;
+		return (LPC_UART0->LSR & (1<<0));
+	}
+
+	uint8_t receive()
+	{
+		if(not buffered)
+		{
+			while(!(LPC_UART0->LSR & (1<<0))); // Wait till the data is received
+			return LPC_UART0->RBR;
+		}
+		uint32_t const tail = receive_tail;
+		while(receive_head == tail);
+		if(dropped and tail == gap_index) {
+			gap_passed = true;
+			dropped = false;
+		}
+		uint8_t const val = receive_buffer[tail];
+		receive_tail = (tail + 1) & (receive_buffer_size - 1);
+		return val;
+	}
+}
 
 /*
 void Serial::init(uint32_t baudrate)
@@ -36,48 +98,118 @@ void Serial::tx(char const * msg)
 		tx(*msg++);
 }
 
-void Serial::tx(const void * data, size_t length)
+uint16_t Serial::tx(const void * data, size_t length)
 {
-	char const * buf = reinterpret_cast<char const *>(data);
+	uint8_t const * buf = reinterpret_cast<uint8_t const *>(data);
+	uint16_t sum = 0;
 	for(size_t i = 0; i < length; i++)
-		tx(buf[i]);
+	{
+		while(!(LPC_UART0->LSR & (1<<5)));
+		LPC_UART0->THR = buf[i];
+		sum += buf[i];
+	}
+	return sum;
 }
 
 bool Serial::available ()
 {
-	return (LPC_UART0->LSR & (1<<0));
+	return receive_ready();
 }
 
 char Serial::rx()
 {
-	char ch;
-	while(!(LPC_UART0->LSR & (1<<0)));  // Wait till the data is received
-	ch = LPC_UART0->RBR;                // Read received data
-	return ch;
+	return char(receive());
+}
+
+uint16_t Serial::rx(void * data, size_t length)
+{
+	uint8_t * buf = reinterpret_cast<uint8_t *>(data);
+	uint16_t sum = 0;
+	for(size_t i = 0; i < length; i++)
+	{
+		uint8_t const val = receive();
+		buf[i] = val;
+		sum += val;
+	}
+	return sum;
+}
+
+void Serial::skip(size_t length)
+{
+	for(size_t i = 0; i < length; i++)
+		(void)receive();
+}
+
+bool Serial::overrun()
+{
+	bool const passed = gap_passed;
+	gap_passed = false;
+	return passed;
 }
 
 static Serial::InterruptHandler custom_isr = nullptr;
 
-static void serial_isr() INTERRUPT;
-static void serial_isr()
+// entry 21 of the vector table in sysinit.cpp, which is part of the image
+// and must not change at runtime (see stage 0's check_and_go)
+extern "C" void UART0_IRQHandler() INTERRUPT;
+extern "C" void UART0_IRQHandler()
 {
 	uint32_t const iir = LPC_UART0->IIR;
 
 	switch(iir & 0x0E)
 	{
-		case 0x08: // Received byte
+		case 0x04: // Receive data available
+		case 0x0C: // Character time-out
 		{
-			char c = LPC_UART0->RBR;
-			custom_isr(c);
+			// drain the FIFO
+			while(LPC_UART0->LSR & (1<<0))
+				custom_isr(char(LPC_UART0->RBR));
 			break;
 		}
 	}
 }
 
+void Serial::enable_receive_buffer()
+{
+	receive_head = 0;
+	receive_tail = 0;
+	dropped = false;
+	gap_passed = false;
+
+	// FIFO enabled, interrupt at 8 bytes, the time-out interrupt
+	// catches the rest
+	LPC_UART0->FCR = 0x81;
+
+	// bytes that arrived before go first
+	while(LPC_UART0->LSR & (1<<0))
+		buffer_byte(char(LPC_UART0->RBR));
+
+	enable_interrupt(buffer_byte);
+	buffered = true;
+}
+
+uint32_t Serial::baudrate()
+{
+	// PCLKSEL0[7:6]: 0 = CCLK/4, 1 = CCLK, 2 = CCLK/2, 3 = CCLK/8
+	static constexpr uint32_t pclk_divider[] = { 4, 1, 2, 8 };
+	uint32_t const pclk = sysclock::cclk() / pclk_divider[(LPC_SC->PCLKSEL0 >> 6) & 0x3];
+
+	LPC_UART0->LCR |= 0x80; // enable DLAB
+	uint32_t const dl = LPC_UART0->DLL | (LPC_UART0->DLM << 8);
+	LPC_UART0->LCR &= ~0x80U;
+
+	uint32_t const mul = (LPC_UART0->FDR >> 4) & 0x0F;
+	uint32_t const add = LPC_UART0->FDR & 0x0F;
+	if(dl == 0 or mul == 0)
+		return 0;
+
+	// baudrate = pclk / (16 * dl * (1 + add / mul))
+	return uint32_t(uint64_t(pclk) * mul / (16ULL * dl * (mul + add)));
+}
+
 void Serial::enable_interrupt(InterruptHandler isr)
 {
 	custom_isr = isr;
-	NVIC_SetHandler(UART0_IRQn, reinterpret_cast<uint32_t>(serial_isr));
 	NVIC_EnableIRQ(UART0_IRQn);
 
 	LPC_UART0->IER = 0x01; // enable receive interrupt
@@ -11,11 +11,31 @@ namespace Serial
 
 	void tx(char ch);
 	void tx(char const * msg);
-	void tx(void const * data, size_t length);
+
+	//! Sends a block of data and returns the 16 bit sum of all bytes.
+	uint16_t tx(void const * data, size_t length);
 
 	bool available ();
 	char rx();
 
+	//! Receives a block of data and returns the 16 bit sum of all bytes.
+	uint16_t rx(void * data, size_t length);
+
+	//! Receives and discards the given number of bytes.
+	void skip(size_t length);
+
+	//! Baud rate of the UART, calculated from its dividers and the CPU clock.
+	uint32_t baudrate();
+
+	//! Receives into a buffer of receive_buffer_size bytes (see protocol.hpp)
+	//! from the UART interrupt, so bytes arriving during IAP operations are
+	//! not lost. All receive functions read from the buffer afterwards.
+	void enable_receive_buffer();
+
+	//! True once after a byte was received that follows bytes the receive
+	//! buffer had to drop because it was full.
+	bool overrun();
+
 	void enable_interrupt(InterruptHandler isr);
 	void disable_interrupt();
 };
@@ -0,0 +1,26 @@
+#include "sysclock.hpp"
+#include <lpc17xx.h>
+
+uint32_t sysclock::cclk()
+{
+	// CLKSRCSEL[1:0]: 0 = internal RC, 1 = main oscillator, 2 = RTC oscillator
+	uint32_t input;
+	switch(LPC_SC->CLKSRCSEL & 0x3)
+	{
+		case 1:  input = main_oscillator; break;
+		case 2:  input = 32768; break;
+		default: input = 4000000; break;
+	}
+
+	uint32_t const divider = (LPC_SC->CCLKCFG & 0xFF) + 1;
+
+	// PLL0STAT[24] enabled, [25] connected
+	uint32_t const status = LPC_SC->PLL0STAT;
+	if((status & (3U << 24)) != (3U << 24))
+		return input / divider;
+
+	// PLL0STAT[14:0] MSEL - 1, [23:16] NSEL - 1, FCCO = 2 · M · input / N
+	uint32_t const m = (status & 0x7FFF) + 1;
+	uint32_t const n = ((status >> 16) & 0xFF) + 1;
+	return uint32_t(2ULL * m * input / n / divider);
+}
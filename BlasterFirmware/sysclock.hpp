@@ -0,0 +1,17 @@
+#ifndef SYSCLOCK_HPP
+#define SYSCLOCK_HPP
+
+#include <cstdint>
+
+//! The clock the controller runs with. The ISP sets it up, the blaster
+//! keeps it, but it depends on the boot ROM and on how the part was reset.
+namespace sysclock
+{
+	//! Crystal on the main oscillator, which the registers can't tell.
+	uint32_t static constexpr main_oscillator = 12000000;
+
+	//! CPU clock in Hz, calculated from CLKSRCSEL, PLL0STAT and CCLKCFG.
+	uint32_t cclk();
+}
+
+#endif // SYSCLOCK_HPP
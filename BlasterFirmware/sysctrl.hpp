@@ -3,20 +3,13 @@
 #include <cstdint>
 
 #include "errorcode.hpp"
-
-extern char ahbram[32768];
+#include "workbuf.hpp"
 
 namespace sysctrl
 {
-	using state = int;
-
-	using SerialHandler = int(*)(state state, uint8_t byte);
-
-	state go(SerialHandler, state initial_state);
-
+	//! Sends ACK, the command was successful.
 	void acknowledge();
 
-	state return_to_main(bool suppress_ack = false);
-
-	state return_to_main(ErrorCode err, uint8_t info = 0);
+	//! Sends NAK followed by the error code and additional info.
+	void nak(ErrorCode err, uint8_t info = 0);
 }
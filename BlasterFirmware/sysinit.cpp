@@ -10,6 +10,8 @@
 
 extern int main();
 
+extern "C" void UART0_IRQHandler(void) INTERRUPT;
+
 typedef void (*ISR_Handler)(void);
 
 static ISR_Handler vector_table[] ALIGNED(1024) SECTION(".isr_vector") USED  =
@@ -36,7 +38,7 @@ static ISR_Handler vector_table[] ALIGNED(1024) SECTION(".isr_vector") USED  =
     IntDefaultHandler,                      // 18 Timer1
     IntDefaultHandler,                      // 19 Timer2
     IntDefaultHandler,                      // 20 Timer3
-    IntDefaultHandler,                           // 21 UART0
+    UART0_IRQHandler,                       // 21 UART0, see serial.cpp
     IntDefaultHandler,                      // 22 UART1
     IntDefaultHandler,                      // 23 UART2
     IntDefaultHandler,                      // 24 UART3
@@ -68,6 +70,9 @@ static ISR_Handler vector_table[] ALIGNED(1024) SECTION(".isr_vector") USED  =
     IntDefaultHandler                       // 50 CAN Activity
 };
 
+extern "C" uint32_t __bss_start[];
+extern "C" uint32_t __bss_end[];
+
 typedef void (*constructor)(void);
 typedef void (*destructor)(void);
 
@@ -116,6 +121,11 @@ extern "C" NORETURN void LPCBlasterEntry()
 	// Fault-Handler aktivieren
 	SCB->SHCSR = 0x00070000;
 
+	// .bss is not part of the uploaded image and a resident blaster
+	// may be started again, so clear it here
+	for(uint32_t * it = __bss_start; it != __bss_end; it++)
+		*it = 0;
+
 	// C++ "hochfahren"
 	cpp_call_global_ctors();
 
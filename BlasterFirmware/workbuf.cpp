@@ -0,0 +1,91 @@
+#include "workbuf.hpp"
+
+extern char ahbram[32768];
+extern char __blaster_end[];
+
+namespace
+{
+	// The ISP runs its stack (max. 256 byte) below the 32 byte IAP area
+	// at the top of the local SRAM. We keep running on it, so leave some room.
+	uintptr_t constexpr local_sram_top = 0x10007FE0;
+	uintptr_t constexpr stack_reserve  = 0x800;
+
+	// The ISP uses the local SRAM up to 0x100001FF, the blaster is
+	// loaded at 0x10001000 (see linker.ld).
+	uintptr_t constexpr isp_ram_end    = 0x10000200;
+	uintptr_t constexpr blaster_start  = 0x10001000;
+
+	uintptr_t align_up(uintptr_t value)
+	{
+		return (value + 0xFFU) & ~uintptr_t(0xFFU);
+	}
+
+	uintptr_t align_down(uintptr_t value)
+	{
+		return value & ~uintptr_t(0xFFU);
+	}
+
+	workbuf::Region regions[3];
+	size_t count;
+	uint32_t total_size;
+
+	void add(uintptr_t start, uintptr_t end)
+	{
+		start = align_up(start);
+		end = align_down(end);
+		if(end <= start)
+			return;
+		regions[count++] = workbuf::Region {
+			reinterpret_cast<uint8_t*>(start),
+			uint32_t(end - start),
+		};
+		total_size += uint32_t(end - start);
+	}
+}
+
+void workbuf::init()
+{
+	count = 0;
+	total_size = 0;
+
+	add(reinterpret_cast<uintptr_t>(ahbram), reinterpret_cast<uintptr_t>(ahbram) + sizeof(ahbram));
+	add(reinterpret_cast<uintptr_t>(__blaster_end), local_sram_top - stack_reserve);
+	add(isp_ram_end, blaster_start);
+}
+
+size_t workbuf::region_count()
+{
+	return count;
+}
+
+const workbuf::Region & workbuf::region(size_t index)
+{
+	return regions[index];
+}
+
+uint32_t workbuf::size()
+{
+	return total_size;
+}
+
+bool workbuf::contains(uint32_t offset, uint32_t length)
+{
+	uint32_t end;
+	if(__builtin_add_overflow(offset, length, &end))
+		return false;
+	return end <= total_size;
+}
+
+uint8_t * workbuf::address(uint32_t offset, uint32_t & contiguous)
+{
+	for(size_t i = 0; i < count; i++)
+	{
+		if(offset < regions[i].length) {
+			contiguous = regions[i].length - offset;
+			return regions[i].start + offset;
+		}
+		offset -= regions[i].length;
+	}
+	contiguous = 0;
+	return nullptr;
+}
@@ -0,0 +1,52 @@
+#ifndef WORKBUF_HPP
+#define WORKBUF_HPP
+
+#include <cstdint>
+#include <cstddef>
+
+//! The work buffer is a list of RAM regions that are addressed as one
+//! continuous range of work offsets. The first region is the AHB SRAM,
+//! so offsets below 32k are the same as in protocol v1.
+namespace workbuf
+{
+	struct Region
+	{
+		uint8_t * start;
+		uint32_t length;
+	};
+
+	//! Computes the region list. Must be called before any other function.
+	void init();
+
+	size_t region_count();
+
+	Region const & region(size_t index);
+
+	//! Total size of all regions.
+	uint32_t size();
+
+	//! Returns true if [offset, offset+length) is inside the work buffer.
+	bool contains(uint32_t offset, uint32_t length);
+
+	//! Returns the address of the given work offset and stores the number of
+	//! bytes that are contiguous from there in `contiguous`.
+	uint8_t * address(uint32_t offset, uint32_t & contiguous);
+
+	//! Calls `fn(uint8_t * ptr, uint32_t length)` for each contiguous piece
+	//! of [offset, offset+length). The range must be checked with contains().
+	template<typename F>
+	void for_each(uint32_t offset, uint32_t length, F && fn)
+	{
+		while(length > 0)
+		{
+			uint32_t contiguous;
+			uint8_t * ptr = address(offset, contiguous);
+			uint32_t const len = (length < contiguous) ? length : contiguous;
+			fn(ptr, len);
+			offset += len;
+			length -= len;
+		}
+	}
+}
+
+#endif // WORKBUF_HPP
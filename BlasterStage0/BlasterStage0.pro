@@ -0,0 +1,18 @@
+TEMPLATE=app
+CONFIG += c++17
+
+CORTEX_M3_OPTIMIZE=s
+CORTEX_M3 = no_hal_init
+CORTEX_M3_LINKERSCRIPT = $$quote($$PWD/linker.ld)
+
+include(/home/felix/projects/lowlevel/cortex-m3-template/cortex-m3.pri)
+
+SOURCES += \
+  stage0.cpp
+
+DISTFILES += \
+  linker.ld
+
+HEADERS += \
+  ../BlasterFirmware/crc32.hpp \
+  ../BlasterFirmware/errorcode.hpp
@@ -0,0 +1,237 @@
+// Stage 0 loader of the LPCBlaster.
+//
+// This is uploaded through the ISP instead of the full firmware, as the ISP
+// only accepts UU-encoded text with a checksum round trip every 20 lines.
+// It switches the UART to a faster baud rate and receives the LPCBlaster
+// firmware in binary, then starts it.
+//
+// It runs on the stack of the ISP without any startup code, so it must not
+// use static variables or interrupts.
+//
+// Protocol (same framing as the LPCBlaster, see README.md):
+// S:set_baudrate(current:u32,baudrate:u32)
+// G:load_and_go(load_address:u32,length:u32,entry:u32,data:u8[length],checksum:u16)
+// C:check_and_go(load_address:u32,length:u32,entry:u32,crc32:u32)
+
+#include <cstdint>
+#include <cstddef>
+#include <lpc17xx.h>
+#include <attributes.h>
+
+#include "../BlasterFirmware/errorcode.hpp"
+#include "../BlasterFirmware/crc32.hpp"
+
+extern char __stage0_end[];
+
+namespace
+{
+	// the firmware must neither overwrite the loader nor the ISP stack
+	// (max. 256 byte below the IAP area at 0x10007FE0)
+	uintptr_t constexpr load_limit = 0x10007E00;
+
+	void tx(uint8_t value)
+	{
+		while(!(LPC_UART0->LSR & (1<<5)));
+		LPC_UART0->THR = value;
+	}
+
+	uint8_t rx()
+	{
+		while(!(LPC_UART0->LSR & (1<<0)));
+		return LPC_UART0->RBR;
+	}
+
+	uint32_t rx_u32()
+	{
+		uint32_t value = 0;
+		for(int i = 0; i < 4; i++)
+			value |= uint32_t(rx()) << (8 * i);
+		return value;
+	}
+
+	void acknowledge()
+	{
+		tx(0x06);
+	}
+
+	void nak(ErrorCode err, uint8_t info = 0)
+	{
+		tx(0x15);
+		tx(uint8_t(err));
+		tx(info);
+	}
+
+	struct Divider
+	{
+		uint32_t dl;
+		uint32_t fdr;
+	};
+
+	uint32_t abs_diff(uint32_t a, uint32_t b)
+	{
+		return (a > b) ? (a - b) : (b - a);
+	}
+
+	//! Finds the divisor and fractional divider for `baudrate`
+	//! with the smallest error. Returns dl = 0 if none is within 2%.
+	Divider find_divider(uint32_t pclk, uint32_t baudrate)
+	{
+		Divider best = { 0, 0x10 };
+		uint32_t best_error = baudrate / 50 + 1;
+		for(uint32_t mul = 1; mul <= 15; mul++)
+		{
+			for(uint32_t add = 0; add < mul; add++)
+			{
+				uint32_t const div = 16 * baudrate * (mul + add);
+				uint32_t const dl = (pclk * mul + div / 2) / div;
+				// with the fractional divider active, DLL must be at least 3
+				if(dl == 0 or dl > 0xFFFF or (add > 0 and dl < 3))
+					continue;
+				uint32_t const actual = pclk * mul / (16 * dl * (mul + add));
+				uint32_t const error = abs_diff(actual, baudrate);
+				if(error < best_error) {
+					best_error = error;
+					best = Divider { dl, (mul << 4) | add };
+				}
+			}
+		}
+		return best;
+	}
+
+	void set_baudrate(uint32_t current, uint32_t baudrate)
+	{
+		if(baudrate == 0)
+			return nak(ErrorCode::OutOfRange);
+
+		// The ISP has configured the UART by autobauding, so the clock of
+		// the UART can be calculated back from the current settings.
+		LPC_UART0->LCR |= 0x80;
+		uint32_t const dl = LPC_UART0->DLL | (LPC_UART0->DLM << 8);
+		LPC_UART0->LCR &= ~0x80U;
+		uint32_t const mul = (LPC_UART0->FDR >> 4) & 0x0F;
+		uint32_t const add = LPC_UART0->FDR & 0x0F;
+
+		uint32_t const mulval = (mul == 0) ? 1 : mul;
+		uint32_t const base = 16 * current * dl;
+		uint32_t const pclk = (base / mulval) * (mulval + add) + (base % mulval) * (mulval + add) / mulval;
+
+		auto const divider = find_divider(pclk, baudrate);
+		if(divider.dl == 0)
+			return nak(ErrorCode::OutOfRange);
+
+		acknowledge();
+
+		// wait until the ACK has left the shift register
+		while(!(LPC_UART0->LSR & (1<<6)));
+
+		LPC_UART0->LCR |= 0x80;
+		LPC_UART0->DLL = divider.dl & 0xFF;
+		LPC_UART0->DLM = (divider.dl >> 8) & 0xFF;
+		LPC_UART0->LCR &= ~0x80U;
+		LPC_UART0->FDR = divider.fdr;
+
+		// drop anything received while switching
+		LPC_UART0->FCR = 0x07;
+	}
+
+	bool valid_image(uint32_t load_address, uint32_t length, uint32_t entry)
+	{
+		return (length > 0)
+			and (load_address >= reinterpret_cast<uintptr_t>(__stage0_end))
+			and (load_address <= load_limit)
+			and (length <= load_limit - load_address)
+			and (entry >= load_address)
+			and (entry - load_address < length);
+	}
+
+	[[noreturn]] void go(uint32_t entry)
+	{
+		acknowledge();
+		while(!(LPC_UART0->LSR & (1<<6)));
+
+		reinterpret_cast<void (*)()>(entry | 1U)();
+		while(true);
+	}
+
+	void load_and_go(uint32_t load_address, uint32_t length, uint32_t entry)
+	{
+		bool const valid = valid_image(load_address, length, entry);
+
+		uint8_t * const dst = reinterpret_cast<uint8_t *>(load_address);
+		uint16_t sum = 0;
+		for(uint32_t i = 0; i < length; i++)
+		{
+			uint8_t const value = rx();
+			if(valid)
+				dst[i] = value;
+			sum += value;
+		}
+		uint16_t checksum = rx();
+		checksum |= uint16_t(rx() << 8);
+
+		if(not valid)
+			return nak(ErrorCode::OutOfRange);
+		if(checksum != sum)
+			return nak(ErrorCode::InvalidChecksum);
+
+		go(entry);
+	}
+
+	//! Starts an image that is still in RAM from a previous session
+	//! (the ISP and a reset keep the RAM content) if it is unchanged.
+	void check_and_go(uint32_t load_address, uint32_t length, uint32_t entry, uint32_t crc)
+	{
+		if(not valid_image(load_address, length, entry))
+			return nak(ErrorCode::OutOfRange);
+
+		if(crc32::compute(reinterpret_cast<void const *>(load_address), length) != crc)
+			return nak(ErrorCode::InvalidChecksum);
+
+		go(entry);
+	}
+}
+
+// This is the entry point, started by the ISP with "G 268435968 T".
+extern "C" NORETURN void Stage0Entry() USED SECTION(".text.entry");
+extern "C" NORETURN void Stage0Entry()
+{
+	for(char const * msg = "LPCBlaster stage 0 ready.\r\n"; *msg; msg++)
+		tx(*msg);
+
+	while(true)
+	{
+		switch(rx())
+		{
+			case 'S':
+			{
+				uint32_t const current = rx_u32();
+				uint32_t const baudrate = rx_u32();
+				set_baudrate(current, baudrate);
+				break;
+			}
+
+			case 'G':
+			{
+				uint32_t const load_address = rx_u32();
+				uint32_t const length = rx_u32();
+				uint32_t const entry = rx_u32();
+				load_and_go(load_address, length, entry);
+				break;
+			}
+
+			case 'C':
+			{
+				uint32_t const load_address = rx_u32();
+				uint32_t const length = rx_u32();
+				uint32_t const entry = rx_u32();
+				uint32_t const crc = rx_u32();
+				check_and_go(load_address, length, entry, crc);
+				break;
+			}
+
+			default:
+				nak(ErrorCode::UnknownCommand);
+				break;
+		}
+	}
+}
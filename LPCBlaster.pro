@@ -1,4 +1,4 @@
 TEMPLATE = subdirs
 
-contains(QMAKE_PLATFORM, arm_baremetal): SUBDIRS += BlasterFirmware
+contains(QMAKE_PLATFORM, arm_baremetal): SUBDIRS += BlasterFirmware BlasterStage0
 contains(QMAKE_PLATFORM, linux): SUBDIRS += LPCBlaster
@@ -4,7 +4,7 @@
 #
 #-------------------------------------------------
 
-QT       += core gui serialport
+QT       += core gui network serialport
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -25,13 +25,50 @@ DEFINES += QT_DEPRECATED_WARNINGS
 CONFIG += c++17
 
 SOURCES += \
+        blaster.cpp \
+        commandtimeouts.cpp \
         elfloader.cpp \
+        flashcommand.cpp \
+        flashjournal.cpp \
+        hashcommand.cpp \
+        imagediff.cpp \
+        imageset.cpp \
         main.cpp \
-        mainwindow.cpp
+        mainwindow.cpp \
+        packetsizer.cpp \
+        patchcommand.cpp \
+        readbackcommand.cpp \
+        sectorcache.cpp \
+        sectorlayout.cpp \
+        sessionreport.cpp \
+        stage0command.cpp \
+        syncsettings.cpp \
+        transport.cpp
 
 HEADERS += \
+        ../BlasterFirmware/crc32.hpp \
+        ../BlasterFirmware/errorcode.hpp \
+        ../BlasterFirmware/protocol.hpp \
+        ../BlasterFirmware/reed_solomon.hpp \
+        blaster.hpp \
+        commandtimeouts.hpp \
         elfloader.hpp \
-        mainwindow.hpp
+        flashcommand.hpp \
+        flashjournal.hpp \
+        hashcommand.hpp \
+        imagediff.hpp \
+        imageset.hpp \
+        mainwindow.hpp \
+        packetsizer.hpp \
+        patchcommand.hpp \
+        readbackcommand.hpp \
+        sectorcache.hpp \
+        sectorlayout.hpp \
+        sessionreport.hpp \
+        spscqueue.hpp \
+        stage0command.hpp \
+        syncsettings.hpp \
+        transport.hpp
 
 FORMS += \
         mainwindow.ui
@@ -0,0 +1,1013 @@
+#include "blaster.hpp"
+#include "sectorlayout.hpp"
+#include "../BlasterFirmware/crc32.hpp"
+#include "../BlasterFirmware/reed_solomon.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+QString Blaster::errorName(ErrorCode code)
+{
+	switch(code)
+	{
+		case ErrorCode::UnknownState:    return "Unknown State";
+		case ErrorCode::InvalidLength:   return "Invalid Length";
+		case ErrorCode::InvalidChecksum: return "Invalid Checksum";
+		case ErrorCode::OutOfRange:      return "Out Of Range";
+		case ErrorCode::NotAligned:      return "Not Aligned";
+		case ErrorCode::IAPFailure:      return "IAP Failure";
+		case ErrorCode::UnknownCommand:  return "Unknown Command";
+		case ErrorCode::ReceiveOverrun:  return "Receive Overrun";
+	}
+	return QString("Error 0x%0").arg(uint8_t(code), 2, 16, QChar('0'));
+}
+
+uint16_t Blaster::checksum(const QByteArray & data)
+{
+	uint16_t cs = 0;
+	for(uint8_t v : data)
+		cs += v;
+	return cs;
+}
+
+QByteArray Blaster::version()
+{
+	return QByteArray("V");
+}
+
+QByteArray Blaster::load_memory(bool wide, uint32_t offset, const QByteArray & data)
+{
+	QByteArray packet;
+	if(wide) {
+		packet.append('l');
+		append<uint32_t>(packet, offset);
+		append<uint32_t>(packet, uint32_t(data.size()));
+	} else {
+		assert(offset <= 0xFFFF and data.size() <= 0xFFFF);
+		packet.append('L');
+		append<uint16_t>(packet, uint16_t(offset));
+		append<uint16_t>(packet, uint16_t(data.size()));
+	}
+	packet.append(data);
+	append<uint16_t>(packet, checksum(data));
+	return packet;
+}
+
+QByteArray Blaster::zero_memory(bool wide, uint32_t offset, uint32_t length)
+{
+	QByteArray packet;
+	if(wide) {
+		packet.append('z');
+		append<uint32_t>(packet, offset);
+		append<uint32_t>(packet, length);
+	} else {
+		assert(offset <= 0xFFFF and length <= 0xFFFF);
+		packet.append('Z');
+		append<uint16_t>(packet, uint16_t(offset));
+		append<uint16_t>(packet, uint16_t(length));
+	}
+	return packet;
+}
+
+QByteArray Blaster::erase_and_write(bool wide, uint32_t flash_offset, uint32_t work_offset, uint32_t length)
+{
+	QByteArray packet;
+	if(wide) {
+		packet.append('w');
+		append<uint32_t>(packet, flash_offset);
+		append<uint32_t>(packet, work_offset);
+		append<uint32_t>(packet, length);
+	} else {
+		assert(work_offset <= 0xFFFF and length <= 0xFFFF);
+		packet.append('W');
+		append<uint32_t>(packet, flash_offset);
+		append<uint16_t>(packet, uint16_t(work_offset));
+		append<uint16_t>(packet, uint16_t(length));
+	}
+	return packet;
+}
+
+QByteArray Blaster::erase_sectors(const std::vector<uint8_t> & sectors)
+{
+	assert(not sectors.empty() and sectors.size() <= 0xFF);
+	QByteArray packet;
+	packet.append('E');
+	append<uint8_t>(packet, uint8_t(sectors.size()));
+	for(uint8_t sector : sectors)
+		append<uint8_t>(packet, sector);
+	return packet;
+}
+
+QByteArray Blaster::full_erase()
+{
+	return QByteArray("F");
+}
+
+QByteArray Blaster::memory_map()
+{
+	return QByteArray("M");
+}
+
+QByteArray Blaster::flash_layout()
+{
+	return QByteArray("T");
+}
+
+QByteArray Blaster::device_info()
+{
+	return QByteArray("I");
+}
+
+QByteArray Blaster::copy_flash(uint32_t flash_offset, uint32_t work_offset, uint32_t length)
+{
+	QByteArray packet;
+	packet.append('C');
+	append<uint32_t>(packet, flash_offset);
+	append<uint32_t>(packet, work_offset);
+	append<uint32_t>(packet, length);
+	return packet;
+}
+
+QByteArray Blaster::hash_sectors(uint8_t first, uint8_t count)
+{
+	QByteArray packet;
+	packet.append('H');
+	packet.append(char(first));
+	packet.append(char(count));
+	return packet;
+}
+
+QByteArray Blaster::program(uint32_t flash_offset, uint32_t work_offset, uint32_t length)
+{
+	QByteArray packet;
+	packet.append('p');
+	append<uint32_t>(packet, flash_offset);
+	append<uint32_t>(packet, work_offset);
+	append<uint32_t>(packet, length);
+	return packet;
+}
+
+QByteArray Blaster::program_list(const std::vector<Extent> & extents)
+{
+	assert(not extents.empty() and extents.size() <= max_extents);
+	QByteArray packet;
+	packet.append('P');
+	append<uint8_t>(packet, uint8_t(extents.size()));
+	for(auto const & extent : extents)
+	{
+		append<uint32_t>(packet, extent.flash_offset);
+		append<uint32_t>(packet, extent.work_offset);
+		append<uint32_t>(packet, extent.length);
+	}
+	return packet;
+}
+
+QByteArray Blaster::fill_memory(uint32_t offset, uint32_t length, uint32_t pattern)
+{
+	QByteArray packet;
+	packet.append('f');
+	append<uint32_t>(packet, offset);
+	append<uint32_t>(packet, length);
+	append<uint32_t>(packet, pattern);
+	return packet;
+}
+
+QByteArray Blaster::load_rle(uint32_t offset, uint32_t length, const QByteArray & encoded)
+{
+	QByteArray packet;
+	packet.append('u');
+	append<uint32_t>(packet, offset);
+	append<uint32_t>(packet, length);
+	append<uint32_t>(packet, uint32_t(encoded.size()));
+	packet.append(encoded);
+	append<uint16_t>(packet, checksum(encoded));
+	return packet;
+}
+
+QByteArray Blaster::rle_encode(const QByteArray & data)
+{
+	QByteArray encoded;
+	int literals = 0; // start of the pending literal bytes
+
+	auto const flush = [&](int end)
+	{
+		while(literals < end)
+		{
+			int const count = std::min(128, end - literals);
+			encoded.append(char(count - 1));
+			encoded.append(data.mid(literals, count));
+			literals += count;
+		}
+	};
+
+	int i = 0;
+	while(i < data.size())
+	{
+		int run = 1;
+		while(i + run < data.size() and run < 130 and data[i + run] == data[i])
+			run += 1;
+
+		if(run >= 3) {
+			flush(i);
+			encoded.append(char(0x80 | (run - 3)));
+			encoded.append(data[i]);
+			literals = i + run;
+		}
+		i += run;
+	}
+	flush(data.size());
+
+	return encoded;
+}
+
+bool Blaster::rle_decode(const char * encoded, int size, char * destination, int length)
+{
+	int position = 0;
+	int i = 0;
+	while(i < size)
+	{
+		uint8_t const c = uint8_t(encoded[i++]);
+		if(c < 0x80) {
+			int const count = c + 1;
+			if(i + count > size or position + count > length)
+				return false;
+			memcpy(destination + position, encoded + i, size_t(count));
+			i += count;
+			position += count;
+		} else {
+			int const count = (c & 0x7F) + 3;
+			if(i >= size or position + count > length)
+				return false;
+			memset(destination + position, encoded[i++], size_t(count));
+			position += count;
+		}
+	}
+	return position == length;
+}
+
+QByteArray Blaster::readback_compressed(uint32_t offset, uint32_t length)
+{
+	QByteArray packet;
+	packet.append('r');
+	append<uint32_t>(packet, offset);
+	append<uint32_t>(packet, length);
+	return packet;
+}
+
+Blaster::Request Blaster::load_request(uint32_t offset, const QByteArray & data)
+{
+	Request request;
+	request.load = Load { offset, data, 0, data.size() };
+	request.bytes = data.size();
+	return request;
+}
+
+QByteArray Blaster::load_fec(uint32_t offset, const QByteArray & data, uint8_t parity)
+{
+	assert(parity > 0 and parity <= fec_max_parity and not data.isEmpty());
+	QByteArray packet;
+	packet.append('D');
+	append<uint32_t>(packet, offset);
+	append<uint32_t>(packet, uint32_t(data.size()));
+	append<uint8_t>(packet, parity);
+
+	uint8_t check[reed_solomon::max_parity];
+	reed_solomon::encode(reinterpret_cast<uint8_t const *>(packet.constData() + 1), 9, check, fec_header_parity);
+	packet.append(reinterpret_cast<char const *>(check), int(fec_header_parity));
+
+	int const block = fec_block_size(parity);
+	for(int start = 0; start < data.size(); start += block)
+	{
+		int const size = std::min(block, data.size() - start);
+		packet.append(data.constData() + start, size);
+		reed_solomon::encode(reinterpret_cast<uint8_t const *>(data.constData() + start), size_t(size), check, parity);
+		packet.append(reinterpret_cast<char const *>(check), parity);
+	}
+	return packet;
+}
+
+int Blaster::fec_block_size(int parity)
+{
+	return int(reed_solomon::max_block) - parity;
+}
+
+int Blaster::fec_reply_size(const QByteArray & received)
+{
+	// corrected:u16, crc32:u32, count:u16, lost:u16[count]
+	if(received.size() < 8)
+		return 8;
+	return 8 + 2 * extract<uint16_t>(received, 6);
+}
+
+QByteArray Blaster::load_packet(uint32_t features, uint32_t offset, const QByteArray & data, int parity)
+{
+	if(has_feature(features, Feature::FillAndRLE) and not data.isEmpty())
+	{
+		uint8_t const first = uint8_t(data[0]);
+		bool const uniform = std::all_of(data.begin(), data.end(), [&](char c) {
+			return uint8_t(c) == first;
+		});
+		if(uniform)
+			return fill_memory(offset, uint32_t(data.size()), first * 0x01010101U);
+	}
+
+	if(parity > 0 and has_feature(features, Feature::ForwardErrorCorrection) and not data.isEmpty())
+		return load_fec(offset, data, uint8_t(parity));
+
+	if(has_feature(features, Feature::FillAndRLE) and not data.isEmpty())
+	{
+		// the u header is 4 bytes larger than the l header
+		auto const encoded = rle_encode(data);
+		if(encoded.size() + 4 < data.size())
+			return load_rle(offset, uint32_t(data.size()), encoded);
+	}
+	return load_memory(has_feature(features, Feature::WideCommands), offset, data);
+}
+
+void Blaster::ReplyReader::reset()
+{
+	stage = Status;
+	reply = Reply { };
+}
+
+std::optional<Blaster::Reply> Blaster::ReplyReader::read(QIODevice & port, PayloadSize const & payloadSize)
+{
+	while(true)
+	{
+		switch(stage)
+		{
+			case Status:
+			{
+				char status;
+				if(not port.getChar(&status))
+					return std::nullopt;
+				if(status == '\006') {
+					reply.ack = true;
+					stage = Payload;
+				} else if(status == '\025') {
+					reply.ack = false;
+					stage = Error;
+				}
+				// anything else is noise in front of the reply
+				break;
+			}
+
+			case Error:
+			{
+				if(port.bytesAvailable() < 2)
+					return std::nullopt;
+				auto const data = port.read(2);
+				reply.error = ErrorCode(uint8_t(data[0]));
+				reply.info = uint8_t(data[1]);
+				auto result = std::move(reply);
+				reset();
+				return result;
+			}
+
+			case Payload:
+			{
+				int const total = payloadSize ? payloadSize(reply.payload) : 0;
+				int const received = reply.payload.size();
+				int const rest = total - received;
+				if(rest > 0) {
+					// read straight into the payload, the size may still grow
+					// (see PayloadSize), so grow the capacity geometrically
+					if(reply.payload.capacity() < total)
+						reply.payload.reserve(std::max(total, 2 * reply.payload.capacity()));
+					reply.payload.resize(total);
+					qint64 const count = port.read(reply.payload.data() + received, rest);
+					reply.payload.resize(received + int(std::max<qint64>(count, 0)));
+					if(count <= 0)
+						return std::nullopt;
+					break;
+				}
+				auto result = std::move(reply);
+				reset();
+				return result;
+			}
+		}
+	}
+}
+
+void Blaster::SequenceCommand::enqueue(Request && request)
+{
+	requests.push_back(std::move(request));
+}
+
+Blaster::SequenceCommand::SequenceCommand()
+{
+	deadline.setSingleShot(true);
+	QObject::connect(&deadline, &QTimer::timeout, [this]() { onTimeout(); });
+}
+
+void Blaster::SequenceCommand::onInit()
+{
+	reader.reset();
+	sent = 0;
+	failed = false;
+	recovery = Recovery::None;
+	recoveries = 0;
+
+	// a load has to fit into the work buffer, and into the 16 bit length
+	// of L without Feature::WideCommands
+	uint32_t limit = owner->blasterWorkSize;
+	if(not has_feature(owner->blasterFeatures, Feature::WideCommands))
+		limit = std::min<uint32_t>(limit, 0xFFFF);
+	owner->packetSizer.setLimit(int(std::min<uint32_t>(limit, PacketSizer::maximum_size)));
+
+	if(requests.empty())
+		return done();
+	beginFront();
+	sendMore();
+	watchFront(false);
+}
+
+//! Check bytes per block of a D packet, 0 for other loads.
+static int fec_parity(QByteArray const & packet)
+{
+	return (packet.size() > 9 and packet[0] == 'D') ? uint8_t(packet[9]) : 0;
+}
+
+//! Commands that keep the blaster reading, so they never fill its receive buffer.
+static bool keeps_reading(QByteArray const & packet)
+{
+	if(packet.isEmpty())
+		return false;
+	switch(packet[0])
+	{
+		case 'L': case 'l': case 'u': case 'D':
+		case 'Z': case 'z': case 'f':
+			return true;
+		default:
+			return false;
+	}
+}
+
+bool Blaster::SequenceCommand::maySend(const Request & next) const
+{
+	if(sent == 0)
+		return true;
+	if(not has_feature(owner->blasterFeatures, Feature::Pipelining))
+		return false;
+
+	// a load that fails is sent again, it must not be overtaken by a
+	// command that uses the work buffer
+	if(not keeps_reading(next.packet)) {
+		for(size_t i = 0; i < sent; i++)
+			if(requests[i].load)
+				return false;
+	}
+
+	// bytes waiting in the receive buffer behind the first command that
+	// stops the blaster from reading. D is decoded block by block while it
+	// arrives, which can fall behind the line, so its own bytes count too.
+	size_t blocked = 0;
+	bool blocking = false;
+	for(size_t i = 0; i < sent; i++)
+	{
+		bool const decoding = fec_parity(requests[i].packet) > 0;
+		if(blocking or decoding)
+			blocked += size_t(requests[i].packet.size());
+		blocking |= decoding or not keeps_reading(requests[i].packet);
+	}
+	if(not blocking)
+		return true;
+	return blocked + size_t(next.packet.size()) <= receive_buffer_size;
+}
+
+void Blaster::SequenceCommand::sendMore()
+{
+	while(sent < requests.size())
+	{
+		prepare(sent);
+		if(not maySend(requests[sent]))
+			break;
+		if(requests[sent].makePayloadSize)
+			requests[sent].payloadSize = requests[sent].makePayloadSize();
+		write(requests[sent].packet);
+		sent += 1;
+	}
+}
+
+//! Data bytes of the largest D packet that fits into the receive buffer, so
+//! maySend() can hold everything behind it back until it is decoded.
+static int fec_capacity(int parity)
+{
+	int const room = int(receive_buffer_size) - (1 + 9 + int(fec_header_parity));
+	int const block = int(reed_solomon::max_block);
+	return (room / block) * Blaster::fec_block_size(parity) + std::max(0, room % block - parity);
+}
+
+void Blaster::SequenceCommand::prepare(size_t index)
+{
+	auto & request = requests[index];
+	if(not request.load or not request.packet.isEmpty())
+		return;
+
+	int const parity = owner->packetSizer.parity();
+	int size = owner->packetSizer.size();
+	if(parity > 0 and has_feature(owner->blasterFeatures, Feature::ForwardErrorCorrection))
+		size = std::min(size, fec_capacity(parity));
+	if(request.load->length > size)
+	{
+		Request rest = request;
+		rest.load->start += size;
+		rest.load->length -= size;
+		rest.bytes = rest.load->length;
+		request.load->length = size;
+		requests.insert(requests.begin() + int(index) + 1, std::move(rest));
+	}
+	auto & head = requests[index];
+	head.packet = load_packet(owner->blasterFeatures, head.load->chunkOffset(), head.load->chunk(), parity);
+	if(fec_parity(head.packet) > 0)
+		head.payloadSize = fec_reply_size;
+	else
+		head.payloadSize = nullptr;
+	head.bytes = head.load->length;
+}
+
+bool Blaster::SequenceCommand::retryLoad(const Request & request)
+{
+	// A stronger code comes before smaller packets. Packets built before
+	// the last change only send their data again, so a burst of noise that
+	// hits several pipelined loads changes the parity once.
+	auto & sizer = owner->packetSizer;
+	bool const fec = has_feature(owner->blasterFeatures, Feature::ForwardErrorCorrection);
+	bool const stale = fec and fec_parity(request.packet) < sizer.parity();
+	if(not stale and not (fec and sizer.strengthen()) and not sizer.failed())
+		return false;
+	owner->report.addRetry();
+
+	// behind the requests in flight, which are loads only
+	Request again = request;
+	again.packet.clear();
+	requests.insert(requests.begin() + int(sent), std::move(again));
+	return true;
+}
+
+bool Blaster::SequenceCommand::completeFecLoad(const Request & request, const Reply & reply)
+{
+	auto const data = request.load->chunk();
+	int const parity = fec_parity(request.packet);
+	int const block = fec_block_size(parity);
+	int const blocks = (data.size() + block - 1) / block;
+	int const corrected = extract<uint16_t>(reply.payload, 0);
+	uint32_t const crc = extract<uint32_t>(reply.payload, 2);
+	int const count = extract<uint16_t>(reply.payload, 6);
+
+	std::vector<int> lost;
+	for(int i = 0; i < count; i++)
+	{
+		int const index = extract<uint16_t>(reply.payload, 8 + 2 * i);
+		if(index >= blocks or (not lost.empty() and index <= lost.back()))
+			return retryLoad(request);
+		lost.push_back(index);
+	}
+
+	// the blaster sends the CRC of the blocks it stored, a block with too
+	// many errors may have been corrected to wrong data
+	uint32_t local = crc32::initial;
+	auto next = lost.begin();
+	for(int i = 0; i < blocks; i++)
+	{
+		if(next != lost.end() and *next == i) {
+			++next;
+			continue;
+		}
+		int const start = i * block;
+		local = crc32::update_fast(local, data.constData() + start, size_t(std::min(block, data.size() - start)));
+	}
+	// corrected to wrong data
+	if(crc32::finish(local) != crc)
+		return retryLoad(request);
+
+	// blocks lost at the strongest code shrink the packets, the sequence
+	// fails once they are as small as they get
+	auto & sizer = owner->packetSizer;
+	if(parity == sizer.parity() and not sizer.decoded(blocks, corrected, count) and not sizer.failed())
+		return false;
+	if(lost.empty())
+		return true;
+
+	// only the lost blocks are sent again, behind the requests in flight
+	owner->report.addRetry();
+	for(auto index = lost.rbegin(); index != lost.rend(); ++index)
+	{
+		int const start = *index * block;
+		Request again = request;
+		again.packet.clear();
+		again.load->start += start;
+		again.load->length = std::min(block, data.size() - start);
+		again.bytes = again.load->length;
+		requests.insert(requests.begin() + int(sent), std::move(again));
+	}
+	return true;
+}
+
+void Blaster::SequenceCommand::beginFront()
+{
+	auto const & request = requests.front();
+	if(not request.phase.isEmpty()) {
+		owner->report.beginPhase(request.phase);
+		owner->report.addBytes(request.bytes);
+	}
+}
+
+void Blaster::SequenceCommand::watchFront(bool pipelined)
+{
+	frontPipelined = pipelined;
+	frontTimer.start();
+	frontDeadlineMs = owner->timeouts.deadlineMs(requests.front().packet, port().baudRate(), owner->flashLayout);
+	deadline.start(frontDeadlineMs);
+}
+
+bool Blaster::SequenceCommand::onData()
+{
+	if(recovery != Recovery::None)
+		return onRecoveryData();
+
+	// a reply that streams data is alive as long as data arrives
+	if(sent > 0 and port().bytesAvailable() > 0)
+		deadline.start(std::max(frontDeadlineMs, owner->timeouts.streamGapMs(port().baudRate())));
+
+	while(sent > 0)
+	{
+		auto const reply = reader.read(port().device(), requests.front().payloadSize);
+		if(not reply)
+			return false;
+
+		auto const request = std::move(requests.front());
+		requests.pop_front();
+		sent -= 1;
+
+		if(failed) {
+			// a previous request failed, only drain the replies
+			if(sent == 0) {
+				requests.clear();
+				finish(false);
+			}
+			else
+				watchFront(true);
+			continue;
+		}
+
+		if(reply->ack) {
+			// the blaster started on a pipelined request when its packet had
+			// long arrived, otherwise the packet was still on the line
+			qint64 const transferred = (frontPipelined ? 0 : request.packet.size()) + 1 + reply->payload.size();
+			owner->timeouts.observe(request.packet, double(frontTimer.nsecsElapsed()) / 1e6, transferred, port().baudRate(), owner->flashLayout);
+			if(request.load)
+				owner->packetSizer.succeeded(request.load->length);
+		}
+
+		if(not reply->ack and reply->error == ErrorCode::InvalidChecksum and reply->info == fec_header_lost and fec_parity(request.packet) > 0) {
+			// the blaster took the rest of the packet for commands
+			owner->logLine(QString("LPCBlaster lost the header of a D load"));
+			owner->packetSizer.strengthen();
+			requests.push_front(request);
+			sent += 1;
+			resynchronize();
+			return false;
+		}
+
+		if(not reply->ack and reply->error == ErrorCode::ReceiveOverrun) {
+			// the blaster dropped bytes of this or a later packet
+			owner->logLine(QString("LPCBlaster receive buffer overran"));
+			requests.push_front(request);
+			sent += 1;
+			resynchronize();
+			return false;
+		}
+
+		bool ok = reply->ack;
+		if(not reply->ack and reply->error == ErrorCode::InvalidChecksum and request.load and retryLoad(request))
+			ok = true;
+		else if(reply->ack and request.load and fec_parity(request.packet) > 0)
+			ok = completeFecLoad(request, *reply);
+		else if(request.onReply)
+			ok = request.onReply(*reply);
+		else if(not reply->ack)
+			owner->logLine(QString("LPCBlaster returned error: %0 (%1)").arg(errorName(reply->error)).arg(reply->info));
+
+		if(not request.phase.isEmpty())
+			owner->report.endPhase(ok);
+
+		if(not ok) {
+			if(sent > 0) {
+				// only drain the replies of the pipelined requests
+				failed = true;
+				watchFront(true);
+				continue;
+			}
+			requests.clear();
+			finish(false);
+			return false;
+		}
+
+		if(requests.empty()) {
+			finish(true);
+			return false;
+		}
+		beginFront();
+		bool const pipelined = sent > 0;
+		sendMore();
+		watchFront(pipelined);
+	}
+	return false;
+}
+
+void Blaster::SequenceCommand::onTimeout()
+{
+	if(isDone)
+		return;
+	switch(recovery)
+	{
+		case Recovery::None:
+			// after a stall of the GUI thread the timer can run before the
+			// readyRead of a reply that arrived in time, onData() handles it
+			// and arms the deadline again
+			if(port().bytesAvailable() > 0) {
+				onData();
+				return;
+			}
+			owner->logLine(QString("LPCBlaster did not answer %0 within %1 ms")
+				.arg(QString::fromLatin1(requests.front().packet.left(1)))
+				.arg(frontDeadlineMs));
+			return resynchronize();
+
+		case Recovery::Draining:
+			return probe();
+
+		case Recovery::Probing:
+			owner->logLine(QString("LPCBlaster does not answer, reconnect it"));
+			return abort();
+	}
+}
+
+void Blaster::SequenceCommand::resynchronize()
+{
+	// The stage 0 loader knows no V, and a failed sequence ends anyway.
+	// Firmware older than this protocol drains whatever length the filler
+	// completes and would swallow the probe, and before V answered the
+	// protocol is unknown.
+	if(failed or owner->idleState != MainWindow::LPCBlasterReady or recoveries >= owner->timeouts.maxRetries)
+		return abort();
+	if(owner->blasterProtocol < protocol_version)
+		return abort();
+
+	recoveries += 1;
+	owner->report.addRetry();
+	recovery = Recovery::Draining;
+	reader.reset();
+
+	// Complete a packet the blaster may still be receiving. A length or count
+	// completed with 0xFF is larger than any valid packet, the blaster rejects
+	// it without draining a payload (see packet::discard), and the surplus
+	// bytes are answered with Unknown Command.
+	int filler = 0;
+	for(size_t i = 0; i < sent; i++)
+		filler = std::max(filler, requests[i].packet.size());
+	port().readAll();
+	write(QByteArray(filler, char(0xFF)));
+
+	// up to three bytes of NAK come back for each byte of filler
+	qint32 const baud = port().baudRate();
+	deadline.start(owner->timeouts.quietMs() + int(CommandTimeouts::transferMs(4 * qint64(filler), baud)));
+}
+
+void Blaster::SequenceCommand::probe()
+{
+	recovery = Recovery::Probing;
+	probeReply.clear();
+	port().readAll();
+	write(version());
+	deadline.start(owner->timeouts.deadlineMs(version(), port().baudRate(), owner->flashLayout));
+}
+
+bool Blaster::SequenceCommand::onRecoveryData()
+{
+	if(recovery == Recovery::Draining) {
+		port().readAll();
+		deadline.start(owner->timeouts.quietMs());
+		return false;
+	}
+	probeReply.append(port().readAll());
+	if(isVersionReply(probeReply))
+		resume();
+	return false;
+}
+
+bool Blaster::SequenceCommand::isVersionReply(const QByteArray & data) const
+{
+	QByteArray expected;
+	expected.append('\006');
+	expected.append(char(owner->blasterProtocol));
+	append<uint32_t>(expected, owner->blasterFeatures);
+	return data == expected;
+}
+
+void Blaster::SequenceCommand::resume()
+{
+	recovery = Recovery::None;
+	for(size_t i = 0; i < sent; i++)
+	{
+		if(not CommandTimeouts::isRetryable(requests[i].packet)) {
+			owner->logLine(QString("LPCBlaster resynchronized, %0 cannot be repeated")
+				.arg(QString::fromLatin1(requests[i].packet.left(1))));
+			return abort();
+		}
+	}
+	owner->logLine(QString("LPCBlaster resynchronized, repeating %0 requests").arg(sent));
+	reader.reset();
+	sent = 0;
+	sendMore();
+	watchFront(false);
+}
+
+void Blaster::SequenceCommand::finish(bool success)
+{
+	deadline.stop();
+	owner->packetSizer.save();
+	done(success);
+}
+
+void Blaster::SequenceCommand::abort()
+{
+	recovery = Recovery::None;
+	if(not failed and not requests.empty() and not requests.front().phase.isEmpty())
+		owner->report.endPhase(false);
+	requests.clear();
+	sent = 0;
+	finish(false);
+}
+
+Blaster::VersionCommand::VersionCommand()
+{
+	Request request;
+	request.packet = version();
+	request.payloadSize = [](QByteArray const &) { return 5; };
+	request.onReply = [this](Reply const & reply)
+	{
+		if(reply.ack) {
+			owner->blasterProtocol = uint8_t(reply.payload[0]);
+			owner->blasterFeatures = extract<uint32_t>(reply.payload, 1);
+		}
+		else if(reply.error == ErrorCode::UnknownCommand) {
+			// firmware predates the version command
+			owner->blasterProtocol = 1;
+			owner->blasterFeatures = 0;
+		}
+		else {
+			return false;
+		}
+		owner->logLine(QString("LPCBlaster protocol v%0, features 0x%1")
+			.arg(owner->blasterProtocol)
+			.arg(owner->blasterFeatures, 8, 16, QChar('0')));
+		if(owner->blasterProtocol < protocol_version) {
+			owner->logLine(QString("BlasterFirmware.bin predates protocol v%0, rebuild it from BlasterFirmware/; "
+				"only the commands it reports are used and lost replies abort the command").arg(protocol_version));
+		}
+
+		owner->blasterWorkSize = 32768;
+		owner->partId = 0;
+		owner->flashLayout = SectorLayout::lpc17xx();
+		if(has_feature(owner->blasterFeatures, Feature::DeviceInfo)) {
+			queryDeviceInfo();
+			return true;
+		}
+		if(has_feature(owner->blasterFeatures, Feature::MemoryMap))
+			queryMemoryMap();
+		if(has_feature(owner->blasterFeatures, Feature::FlashLayout))
+			queryFlashLayout();
+		return true;
+	};
+	enqueue(std::move(request));
+}
+
+void Blaster::VersionCommand::queryMemoryMap()
+{
+	Request request;
+	request.packet = memory_map();
+	request.payloadSize = [](QByteArray const & received)
+	{
+		if(received.isEmpty())
+			return 1;
+		return 1 + 8 * int(uint8_t(received[0]));
+	};
+	request.onReply = [this](Reply const & reply)
+	{
+		if(not reply.ack)
+			return false;
+
+		int const count = uint8_t(reply.payload[0]);
+		uint32_t size = 0;
+		for(int i = 0; i < count; i++)
+		{
+			uint32_t const start = extract<uint32_t>(reply.payload, 1 + 8 * i);
+			uint32_t const length = extract<uint32_t>(reply.payload, 5 + 8 * i);
+			owner->logLine(QString("work buffer 0x%0 … 0x%1 (%2 bytes)")
+				.arg(start, 8, 16, QChar('0'))
+				.arg(start + length - 1, 8, 16, QChar('0'))
+				.arg(length));
+			size += length;
+		}
+		owner->blasterWorkSize = size;
+		return true;
+	};
+	enqueue(std::move(request));
+}
+
+void Blaster::VersionCommand::queryFlashLayout()
+{
+	Request request;
+	request.packet = flash_layout();
+	request.payloadSize = [](QByteArray const & received)
+	{
+		if(received.size() < 5)
+			return 5;
+		return 5 + 8 * int(uint8_t(received[4]));
+	};
+	request.onReply = [this](Reply const & reply)
+	{
+		if(not reply.ack)
+			return false;
+
+		int const count = uint8_t(reply.payload[4]);
+		std::vector<SectorLayout::Sector> sectors;
+		for(int i = 0; i < count; i++)
+		{
+			sectors.push_back(SectorLayout::Sector {
+				extract<uint32_t>(reply.payload, 5 + 8 * i),
+				extract<uint32_t>(reply.payload, 9 + 8 * i),
+			});
+		}
+		owner->partId = extract<uint32_t>(reply.payload, 0);
+		owner->flashLayout = SectorLayout(std::move(sectors));
+		owner->logLine(QString("part 0x%0, %1 kB flash in %2 sectors")
+			.arg(owner->partId, 8, 16, QChar('0'))
+			.arg(owner->flashLayout.flashSize() / 1024)
+			.arg(count));
+		return true;
+	};
+	enqueue(std::move(request));
+}
+
+void Blaster::VersionCommand::queryDeviceInfo()
+{
+	// protocol, features, part ID, boot version, serial, clock,
+	// baud rate, flash size, work size and region count
+	static constexpr int fixed_size = 1 + 4 + 4 + 4 + 16 + 4 + 4 + 4 + 4 + 1;
+
+	Request request;
+	request.packet = device_info();
+	request.payloadSize = [](QByteArray const & received)
+	{
+		if(received.size() < fixed_size)
+			return fixed_size;
+		return fixed_size + 8 * int(uint8_t(received[fixed_size - 1]));
+	};
+	request.onReply = [this](Reply const & reply)
+	{
+		if(not reply.ack)
+			return false;
+
+		QStringList serial;
+		for(int i = 0; i < 4; i++)
+			serial << QString("%0").arg(extract<uint32_t>(reply.payload, 13 + 4 * i), 8, 16, QChar('0'));
+
+		owner->partId = extract<uint32_t>(reply.payload, 5);
+		uint32_t const boot_version = extract<uint32_t>(reply.payload, 9);
+		uint32_t const clock = extract<uint32_t>(reply.payload, 29);
+		uint32_t const baudrate = extract<uint32_t>(reply.payload, 33);
+		uint32_t const flash_size = extract<uint32_t>(reply.payload, 37);
+		owner->blasterWorkSize = extract<uint32_t>(reply.payload, 41);
+		owner->flashLayout = SectorLayout::lpc17xx(flash_size);
+
+		// same format as the identity read through the ISP
+		owner->deviceIdentity = QString("%0-%1").arg(owner->partId, 8, 16, QChar('0')).arg(serial.join("-"));
+
+		owner->logLine(QString("part 0x%0, boot ROM %1.%2, %3 kB flash, serial %4")
+			.arg(owner->partId, 8, 16, QChar('0'))
+			.arg(boot_version >> 8)
+			.arg(boot_version & 0xFF)
+			.arg(flash_size / 1024)
+			.arg(serial.join("-")));
+		owner->logLine(QString("CCLK %0 Hz, %1 Baud, work buffer %2 bytes")
+			.arg(clock)
+			.arg(baudrate)
+			.arg(owner->blasterWorkSize));
+
+		int const count = uint8_t(reply.payload[fixed_size - 1]);
+		for(int i = 0; i < count; i++)
+		{
+			uint32_t const start = extract<uint32_t>(reply.payload, fixed_size + 8 * i);
+			uint32_t const length = extract<uint32_t>(reply.payload, fixed_size + 4 + 8 * i);
+			owner->logLine(QString("work buffer 0x%0 … 0x%1 (%2 bytes)")
+				.arg(start, 8, 16, QChar('0'))
+				.arg(start + length - 1, 8, 16, QChar('0'))
+				.arg(length));
+		}
+		return true;
+	};
+	enqueue(std::move(request));
+}
@@ -0,0 +1,263 @@
+#ifndef BLASTER_HPP
+#define BLASTER_HPP
+
+#include "mainwindow.hpp"
+#include "../BlasterFirmware/errorcode.hpp"
+#include "../BlasterFirmware/protocol.hpp"
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QIODevice>
+#include <QTimer>
+#include <deque>
+#include <functional>
+#include <optional>
+#include <vector>
+
+namespace Blaster
+{
+	QString errorName(ErrorCode code);
+
+	//! Appends a little endian integer to a packet.
+	template<typename T>
+	void append(QByteArray & packet, T value)
+	{
+		static_assert(std::is_integral_v<T>);
+		for(size_t i = 0; i < sizeof(T); i++)
+			packet.append(char((value >> (8 * i)) & 0xFF));
+	}
+
+	//! Reads a little endian integer from a reply payload.
+	template<typename T>
+	T extract(QByteArray const & data, int offset)
+	{
+		static_assert(std::is_integral_v<T>);
+		assert(offset + int(sizeof(T)) <= data.size());
+		T value = 0;
+		for(size_t i = 0; i < sizeof(T); i++)
+			value |= T(uint8_t(data[offset + int(i)])) << (8 * i);
+		return value;
+	}
+
+	//! 16 bit sum of all bytes, used by load and readback.
+	uint16_t checksum(QByteArray const & data);
+
+	QByteArray version();
+	QByteArray load_memory(bool wide, uint32_t offset, QByteArray const & data);
+	QByteArray zero_memory(bool wide, uint32_t offset, uint32_t length);
+	QByteArray erase_and_write(bool wide, uint32_t flash_offset, uint32_t work_offset, uint32_t length);
+	QByteArray erase_sectors(std::vector<uint8_t> const & sectors);
+	QByteArray full_erase();
+	QByteArray memory_map();
+	QByteArray flash_layout();
+	QByteArray device_info();
+	QByteArray copy_flash(uint32_t flash_offset, uint32_t work_offset, uint32_t length);
+	QByteArray hash_sectors(uint8_t first, uint8_t count);
+	QByteArray program(uint32_t flash_offset, uint32_t work_offset, uint32_t length);
+	struct Extent
+	{
+		uint32_t flash_offset;
+		uint32_t work_offset;
+		uint32_t length;
+	};
+
+	//! Maximum number of extents of a single P command, see erase_and_write.hpp.
+	static constexpr size_t max_extents = 32;
+
+	QByteArray program_list(std::vector<Extent> const & extents);
+	QByteArray fill_memory(uint32_t offset, uint32_t length, uint32_t pattern);
+	QByteArray load_rle(uint32_t offset, uint32_t length, QByteArray const & encoded);
+
+	//! Run length encoding of the u command, see BlasterFirmware/modules/data_loader.hpp.
+	QByteArray rle_encode(QByteArray const & data);
+
+	//! Decodes `size` bytes into `destination`. Returns false if they
+	//! do not decode to exactly `length` bytes.
+	bool rle_decode(char const * encoded, int size, char * destination, int length);
+
+	QByteArray readback_compressed(uint32_t offset, uint32_t length);
+
+	//! Reed-Solomon protected load with `parity` check bytes per block,
+	//! see BlasterFirmware/modules/data_loader.hpp.
+	QByteArray load_fec(uint32_t offset, QByteArray const & data, uint8_t parity);
+
+	//! Data bytes per block of a D packet with `parity` check bytes.
+	int fec_block_size(int parity);
+
+	//! Payload size of the reply to D.
+	int fec_reply_size(QByteArray const & received);
+
+	//! Builds the smallest packet that loads `data` to `offset`: a fill,
+	//! a run length encoded or a plain load, depending on the features.
+	//! With `parity` > 0 and Feature::ForwardErrorCorrection, data that is
+	//! not a fill is sent with D instead.
+	QByteArray load_packet(uint32_t features, uint32_t offset, QByteArray const & data, int parity = 0);
+
+	struct Reply
+	{
+		bool ack = false;
+		ErrorCode error = ErrorCode::UnknownState;
+		uint8_t info = 0;
+		QByteArray payload;
+	};
+
+	//! Returns the total number of payload bytes following an ACK,
+	//! given the payload bytes received so far.
+	using PayloadSize = std::function<int(QByteArray const & received)>;
+
+	//! Incrementally parses ACK/NAK replies and their payload.
+	class ReplyReader
+	{
+		enum Stage { Status, Error, Payload };
+		Stage stage = Status;
+		Reply reply;
+	public:
+		void reset();
+
+		//! Consumes data from the port and returns the reply once it is complete.
+		std::optional<Reply> read(QIODevice & port, PayloadSize const & payloadSize);
+	};
+
+	//! Data for the work buffer, see Request::load. The packets a load is
+	//! split into share `data` and only differ in `start` and `length`.
+	struct Load
+	{
+		uint32_t offset;  // of data[0] in the work buffer
+		QByteArray data;
+		int start = 0;
+		int length = 0;
+
+		uint32_t chunkOffset() const { return offset + uint32_t(start); }
+
+		//! The part of `data` sent in this packet, without copying it.
+		QByteArray chunk() const { return QByteArray::fromRawData(data.constData() + start, length); }
+	};
+
+	struct Request
+	{
+		QByteArray packet;
+		PayloadSize payloadSize;
+		//! If set, builds `payloadSize` each time the packet is sent, for
+		//! parsers that keep state between the chunks of a reply. A reply
+		//! to a packet that is sent again after a resynchronization starts
+		//! from scratch.
+		std::function<PayloadSize()> makePayloadSize;
+		//! Handles the reply, returns false to abort the sequence.
+		std::function<bool(Reply const &)> onReply;
+		//! Session report phase and number of payload bytes accounted to it.
+		QString phase;
+		qint64 bytes = 0;
+		//! If set, `packet` is built from it when the request is sent. The
+		//! data is split into packets of MainWindow::packetSizer, and sent
+		//! again in smaller packets if the blaster reports Invalid Checksum.
+		std::optional<Load> load;
+	};
+
+	//! Request that loads `data` to `offset` of the work buffer.
+	Request load_request(uint32_t offset, QByteArray const & data);
+
+	//! Executes a list of requests one after another.
+	//!
+	//! With Feature::Pipelining, requests are sent before the replies of the
+	//! previous ones arrived. Commands that keep the blaster reading (loads
+	//! and fills) are streamed without limit, behind any other command only
+	//! receive_buffer_size bytes are sent until its reply arrived. D is
+	//! decoded while it arrives and counts with its own bytes. Other
+	//! commands wait for the replies of all loads before them, so a load
+	//! that is sent again still arrives before the write that uses it.
+	//!
+	//! Each reply has a deadline from MainWindow::timeouts. When it passes,
+	//! the blaster is resynchronized and the requests in flight are sent
+	//! again if they can be repeated, otherwise the sequence fails.
+	struct SequenceCommand : MainWindow::Command
+	{
+		std::deque<Request> requests;
+		ReplyReader reader;
+
+		SequenceCommand();
+
+		void onInit() override;
+		bool onData() override;
+
+		void enqueue(Request && request);
+
+	private:
+		//! Number of requests at the front of `requests` that were sent.
+		size_t sent = 0;
+
+		//! A request failed, the replies of the sent requests are discarded.
+		bool failed = false;
+
+		//! Sends as many requests as the receive buffer of the blaster allows.
+		void sendMore();
+
+		//! Builds the packet of a load request, splitting off the data that
+		//! exceeds the current packet size into a new request behind it.
+		void prepare(size_t index);
+
+		//! Sends the data of a load that failed with Invalid Checksum again
+		//! with a stronger code or in smaller packets. Returns false if
+		//! neither is possible.
+		bool retryLoad(Request const & request);
+
+		//! Checks the reply to a D load and sends the blocks the blaster
+		//! could not correct again.
+		bool completeFecLoad(Request const & request, Reply const & reply);
+
+		bool maySend(Request const & next) const;
+
+		//! Starts the report phase of the request at the front.
+		void beginFront();
+
+		QTimer deadline;
+		QElapsedTimer frontTimer;
+		int frontDeadlineMs = 0;
+		bool frontPipelined = false;
+
+		//! Arms the deadline of the reply to the request at the front.
+		//! `pipelined` tells if it was sent before it became the front.
+		void watchFront(bool pipelined);
+
+		enum class Recovery { None, Draining, Probing };
+		Recovery recovery = Recovery::None;
+		int recoveries = 0;
+		QByteArray probeReply;
+
+		void onTimeout();
+
+		//! Completes a packet the blaster may still be receiving and waits
+		//! until it stopped answering.
+		void resynchronize();
+
+		//! Checks with V that the blaster is in sync again.
+		void probe();
+
+		bool onRecoveryData();
+
+		bool isVersionReply(QByteArray const & data) const;
+
+		//! Sends the requests in flight again after a resynchronization.
+		void resume();
+
+		void finish(bool success);
+
+		void abort();
+	};
+
+	//! Queries protocol version and features of the running blaster,
+	//! followed by the device information if the blaster supports I, or
+	//! by the work buffer size and the flash layout if it reports them.
+	struct VersionCommand : SequenceCommand
+	{
+		VersionCommand();
+
+	private:
+		void queryMemoryMap();
+
+		void queryFlashLayout();
+
+		void queryDeviceInfo();
+	};
+}
+
+#endif // BLASTER_HPP
@@ -0,0 +1,128 @@
+#include "commandtimeouts.hpp"
+#include "blaster.hpp"
+
+#include <QSettings>
+#include <algorithm>
+#include <cmath>
+
+//! Weight of a new measurement in the learned values.
+static constexpr double learning_rate = 0.25;
+
+double CommandTimeouts::workUnits(const QByteArray & packet, const SectorLayout & layout)
+{
+	using Blaster::extract;
+	if(packet.isEmpty())
+		return 0;
+	auto const kib = [](uint32_t bytes) { return bytes / 1024.0; };
+	switch(packet[0])
+	{
+		case 'W':
+			return packet.size() >= 9 ? kib(extract<uint16_t>(packet, 7)) : 0;
+		case 'w':
+		case 'p':
+			return packet.size() >= 13 ? kib(extract<uint32_t>(packet, 9)) : 0;
+		case 'P':
+		{
+			double units = 0;
+			for(int at = 2; at + 12 <= packet.size(); at += 12)
+				units += kib(extract<uint32_t>(packet, at + 8));
+			return units;
+		}
+		case 'E':
+			return packet.size() >= 2 ? uint8_t(packet[1]) : 0;
+		case 'F':
+			return double(layout.count());
+		case 'H':
+		{
+			if(packet.size() < 3)
+				return 0;
+			size_t const first = uint8_t(packet[1]);
+			size_t const count = uint8_t(packet[2]);
+			uint32_t bytes = 0;
+			for(size_t i = first; i < first + count and i < layout.count(); i++)
+				bytes += layout[i].length;
+			return kib(bytes);
+		}
+		case 'Z':
+			return packet.size() >= 5 ? kib(extract<uint16_t>(packet, 3)) : 0;
+		case 'z':
+		case 'f':
+		case 'D':
+			return packet.size() >= 9 ? kib(extract<uint32_t>(packet, 5)) : 0;
+		default:
+			return 0;
+	}
+}
+
+double CommandTimeouts::transferMs(qint64 bytes, qint32 baud)
+{
+	// start bit, 8 data bits, stop bit
+	return 1000.0 * 10.0 * double(bytes) / double(std::max(baud, 1));
+}
+
+int CommandTimeouts::deadlineMs(const QByteArray & packet, qint32 baud, const SectorLayout & layout) const
+{
+	double expected = latencyMs + transferMs(packet.size(), baud);
+	if(double const units = workUnits(packet, layout); units > 0 and not packet.isEmpty())
+	{
+		auto const rate = msPerUnit.find(packet[0]);
+		if(rate != msPerUnit.end())
+			expected += units * rate->second;
+	}
+	return minimumMs + int(std::ceil(margin * expected));
+}
+
+int CommandTimeouts::streamGapMs(qint32 baud) const
+{
+	return minimumMs + int(std::ceil(margin * (latencyMs + transferMs(readback_block_size, baud))));
+}
+
+int CommandTimeouts::quietMs() const
+{
+	return minimumMs + int(std::ceil(margin * latencyMs));
+}
+
+void CommandTimeouts::observe(const QByteArray & packet, double elapsedMs, qint64 transferred, qint32 baud, const SectorLayout & layout)
+{
+	double const residual = std::max(0.0, elapsedMs - transferMs(transferred, baud));
+	double const units = workUnits(packet, layout);
+	if(units <= 0) {
+		latencyMs += learning_rate * (residual - latencyMs);
+		return;
+	}
+	auto const rate = msPerUnit.find(packet[0]);
+	if(rate == msPerUnit.end())
+		return;
+	double const sample = std::max(0.0, residual - latencyMs) / units;
+	rate->second += learning_rate * (sample - rate->second);
+}
+
+bool CommandTimeouts::isRetryable(const QByteArray & packet)
+{
+	if(packet.isEmpty())
+		return false;
+	switch(packet[0])
+	{
+		case 'L': case 'l': case 'u': case 'D':
+		case 'Z': case 'z': case 'f':
+		case 'E': case 'F':
+		case 'V': case 'M': case 'T': case 'I':
+		case 'R': case 'r': case 'H': case 'C':
+			return true;
+		default:
+			return false;
+	}
+}
+
+CommandTimeouts CommandTimeouts::load(const QString & fileName)
+{
+	CommandTimeouts result;
+	QSettings settings(fileName, QSettings::IniFormat);
+	settings.beginGroup("timeouts");
+	result.minimumMs  = std::max(1, settings.value("minimumMs", result.minimumMs).toInt());
+	result.margin     = std::max(1.0, settings.value("margin", result.margin).toDouble());
+	result.maxRetries = std::max(0, settings.value("maxRetries", result.maxRetries).toInt());
+	result.latencyMs  = settings.value("latencyMs", result.latencyMs).toDouble();
+	settings.endGroup();
+	return result;
+}
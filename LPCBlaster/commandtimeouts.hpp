@@ -0,0 +1,61 @@
+#ifndef COMMANDTIMEOUTS_HPP
+#define COMMANDTIMEOUTS_HPP
+
+#include <QByteArray>
+#include <QString>
+#include <map>
+
+#include "sectorlayout.hpp"
+
+//! Deadlines of blaster commands. The expected duration of a command is
+//! the transfer time of its packet at the current baud rate, the round
+//! trip latency and the time the blaster works on it (erasing, writing,
+//! hashing). Latency and work rates start with conservative defaults and
+//! follow the measured replies.
+//! The defaults can be overridden in the [timeouts] group of LPCBlaster.ini.
+struct CommandTimeouts
+{
+	int minimumMs = 250;     // added to every deadline
+	double margin = 3.0;     // deadline = minimumMs + margin × expected duration
+	int maxRetries = 2;      // resynchronizations per sequence before giving up
+	double latencyMs = 20;   // round trip latency, learned
+
+	//! Work rates in ms per unit of workUnits(), learned per command.
+	std::map<char, double> msPerUnit {
+		{ 'W', 8.0 }, { 'w', 8.0 },     // per KiB erased and written
+		{ 'p', 4.0 }, { 'P', 4.0 },     // per KiB written
+		{ 'E', 100.0 }, { 'F', 100.0 }, // per sector
+		{ 'H', 0.1 },                   // per KiB hashed
+		{ 'Z', 0.01 }, { 'z', 0.01 }, { 'f', 0.01 }, // per KiB filled
+		{ 'D', 0.5 },                   // per KiB decoded
+	};
+
+	//! Amount of work the blaster does after it received `packet`, in the
+	//! unit of msPerUnit. Loads and queries have none.
+	static double workUnits(QByteArray const & packet, SectorLayout const & layout);
+
+	//! Time to transfer `bytes` over the serial line (8N1).
+	static double transferMs(qint64 bytes, qint32 baud);
+
+	//! Time until the reply to `packet` must have started.
+	int deadlineMs(QByteArray const & packet, qint32 baud, SectorLayout const & layout) const;
+
+	//! Longest pause inside a reply that streams data, like a readback.
+	int streamGapMs(qint32 baud) const;
+
+	//! Pause after which no more data is expected.
+	int quietMs() const;
+
+	//! Learns from a reply that took `elapsedMs` after the blaster could
+	//! start on `packet`, of which `transferred` bytes were sent or received.
+	void observe(QByteArray const & packet, double elapsedMs, qint64 transferred, qint32 baud, SectorLayout const & layout);
+
+	//! Commands that can be sent again after a lost reply. Commands that
+	//! write flash from the work buffer are not, later loads may already
+	//! have replaced its content.
+	static bool isRetryable(QByteArray const & packet);
+
+	static CommandTimeouts load(QString const & fileName);
+};
+
+#endif // COMMANDTIMEOUTS_HPP
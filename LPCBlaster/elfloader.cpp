@@ -4,6 +4,7 @@
 #include <QDebug>
 #include <elf.h>
 #include <cstdio>
+#include <vector>
 
 template<typename T>
 static T read(QByteArray const & src, uint32_t offset)
@@ -15,15 +16,10 @@ static T read(QByteArray const & src, uint32_t offset)
 	return result;
 }
 
-std::optional<std::tuple<QByteArray, uint32_t> > ELFLoader::load_binary(const QString & fileName)
+static std::optional<Elf32_Ehdr> read_header(QByteArray const & elf)
 {
-	QByteArray elf;
-	{
-		QFile file(fileName);
-		if(not file.open(QFile::ReadOnly))
-			return std::nullopt;
-		elf = file.readAll();
-	}
+	if(elf.size() < int(sizeof(Elf32_Ehdr)))
+		return std::nullopt;
 
 	auto const file_header = read<Elf32_Ehdr>(elf, 0);
 
@@ -42,8 +38,31 @@ std::optional<std::tuple<QByteArray, uint32_t> > ELFLoader::load_binary(const QS
 	if(file_header.e_machine != EM_ARM) return std::nullopt;
 	if(file_header.e_version != EV_CURRENT) return std::nullopt;
 
-	uint32_t start_address = 0x10001000;
+	return file_header;
+}
+
+static std::optional<QByteArray> read_file(QString const & fileName)
+{
+	QFile file(fileName);
+	if(not file.open(QFile::ReadOnly))
+		return std::nullopt;
+	return file.readAll();
+}
+
+std::optional<std::tuple<QByteArray, uint32_t, uint32_t> > ELFLoader::load_binary(const QString & fileName, uint32_t start_address)
+{
+	auto const elf_data = read_file(fileName);
+	if(not elf_data)
+		return std::nullopt;
+	QByteArray const & elf = *elf_data;
+
+	auto const header = read_header(elf);
+	if(not header)
+		return std::nullopt;
+	auto const & file_header = *header;
+
 	QByteArray binary;
+	uint32_t initialized = 0;
 
 	fprintf(stderr, "Sections:\n");
 	for(size_t i = 0; i < file_header.e_shnum; i++)
@@ -62,7 +81,9 @@ std::optional<std::tuple<QByteArray, uint32_t> > ELFLoader::load_binary(const QS
 		);
 		fflush(stderr);
 
-		if(shdr.sh_type == SHT_PROGBITS or shdr.sh_type == SHT_NOBITS)
+		// .bss is sent cleared, firmware older than the stage 0 loader does
+		// not clear it itself
+		if((shdr.sh_type == SHT_PROGBITS or shdr.sh_type == SHT_NOBITS) and (shdr.sh_flags & SHF_ALLOC))
 		{
 			assert(shdr.sh_addr >= start_address);
 
@@ -77,6 +98,7 @@ std::optional<std::tuple<QByteArray, uint32_t> > ELFLoader::load_binary(const QS
 					elf.data() + shdr.sh_offset,
 					shdr.sh_size
 				);
+				initialized = std::max(initialized, binary_offset + shdr.sh_size);
 			}
 			else
 			{
@@ -86,9 +108,56 @@ std::optional<std::tuple<QByteArray, uint32_t> > ELFLoader::load_binary(const QS
 					shdr.sh_size
 				);
 			}
-
 		}
 	}
 
-	return std::make_tuple(std::move(binary), file_header.e_entry);
+	return std::make_tuple(std::move(binary), file_header.e_entry, initialized);
+}
+
+std::optional<std::tuple<QByteArray, uint32_t> > ELFLoader::load_image(const QString & fileName)
+{
+	auto const elf_data = read_file(fileName);
+	if(not elf_data)
+		return std::nullopt;
+	QByteArray const & elf = *elf_data;
+
+	auto const header = read_header(elf);
+	if(not header)
+		return std::nullopt;
+	auto const & file_header = *header;
+
+	std::vector<Elf32_Phdr> segments;
+	for(size_t i = 0; i < file_header.e_phnum; i++)
+	{
+		auto const phdr = read<Elf32_Phdr>(elf, file_header.e_phoff + file_header.e_phentsize * i);
+		if(phdr.p_type != PT_LOAD or phdr.p_filesz == 0)
+			continue;
+		if(phdr.p_offset + phdr.p_filesz > uint32_t(elf.size()))
+			return std::nullopt;
+		segments.push_back(phdr);
+	}
+	if(segments.empty())
+		return std::nullopt;
+
+	// segments are placed at their load address (LMA), so
+	// initialized data ends up behind the code in flash.
+	uint32_t start_address = UINT32_MAX;
+	uint32_t end_address = 0;
+	for(auto const & phdr : segments)
+	{
+		start_address = std::min(start_address, phdr.p_paddr);
+		end_address = std::max(end_address, phdr.p_paddr + phdr.p_filesz);
+	}
+
+	QByteArray image(int(end_address - start_address), char(0xFF));
+	for(auto const & phdr : segments)
+	{
+		memcpy(
+			image.data() + (phdr.p_paddr - start_address),
+			elf.data() + phdr.p_offset,
+			phdr.p_filesz
+		);
+	}
+
+	return std::make_tuple(std::move(image), start_address);
 }
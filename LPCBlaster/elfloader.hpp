@@ -8,7 +8,15 @@
 
 namespace ELFLoader
 {
-	std::optional<std::tuple<QByteArray, uint32_t>> load_binary(QString const & fileName);
+	//! Loads all sections of a RAM image linked to `start_address`.
+	//! Returns the image with .bss cleared, the entry point and the size of
+	//! the initialized part in front of .bss, which does not change while
+	//! the image runs.
+	std::optional<std::tuple<QByteArray, uint32_t, uint32_t>> load_binary(QString const & fileName, uint32_t start_address = 0x10001000);
+
+	//! Loads the flash image of an ELF file from its loadable segments.
+	//! Returns the image (gaps filled with 0xFF) and its start address.
+	std::optional<std::tuple<QByteArray, uint32_t>> load_image(QString const & fileName);
 };
 
 #endif // ELFLOADER_HPP
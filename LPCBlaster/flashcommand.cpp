@@ -0,0 +1,238 @@
+#include "flashcommand.hpp"
+
+#include <algorithm>
+
+FlashCommand::FlashCommand(uint32_t base_address, const QByteArray & image, const SectorLayout & layout, uint32_t features, uint32_t work_size) :
+  features(features)
+{
+	// the IAP writes in multiples of 256 byte, so pad the image
+	// with the erased state of the flash
+	uint32_t const start = base_address & ~0xFFU;
+	firstAddress = start;
+	uint32_t const end = (base_address + uint32_t(image.size()) + 0xFFU) & ~0xFFU;
+
+	QByteArray data = QByteArray(int(base_address - start), char(0xFF)) + image;
+	data.append(QByteArray(int(end - start) - data.size(), char(0xFF)));
+
+	for(uint32_t address : { start, end - 1 })
+	{
+		if(not layout.sectorOf(address)) {
+			error = QString("address 0x%0 is not inside the flash").arg(address, 8, 16, QChar('0'));
+			return;
+		}
+	}
+
+	if(has_feature(features, Feature::ProgramOnly))
+		planEraseFirst(start, data, layout, work_size);
+	else
+		planSectorBatches(start, data, layout, work_size);
+}
+
+void FlashCommand::planEraseFirst(uint32_t start, const QByteArray & data, const SectorLayout & layout, uint32_t work_size)
+{
+	uint32_t const end = start + uint32_t(data.size());
+
+	uint32_t const chunk_size = work_size & ~0xFFU;
+	if(chunk_size == 0) {
+		error = "the work buffer is smaller than 256 bytes";
+		return;
+	}
+
+	// The upper sectors of the LPC17xx are 32k large, so batches of whole
+	// sectors can't use a work buffer larger than 32k. Erasing everything
+	// first allows loading and writing chunks of the full work buffer.
+	std::vector<uint8_t> sectors;
+	for(size_t s = *layout.sectorOf(start); s < layout.count() and layout[s].start_address < end; s++)
+		sectors.push_back(uint8_t(s));
+
+	Blaster::Request erase;
+	erase.packet = (sectors.size() == layout.count()) ? Blaster::full_erase() : Blaster::erase_sectors(sectors);
+	erase.phase = "erase";
+	erase.onReply = [this, end](Blaster::Reply const & reply)
+	{
+		if(not reply.ack) {
+			owner->logLine(QString("failed to erase: %0 (%1)")
+				.arg(Blaster::errorName(reply.error))
+				.arg(reply.info));
+			return false;
+		}
+		record(end, FlashJournal::State::Erased);
+		return true;
+	};
+	enqueue(std::move(erase));
+
+	// collect the pages that are not erased, adjacent pages are
+	// written as a single extent
+	std::vector<Blaster::Extent> extents;
+	QByteArray packed;
+
+	auto const flush = [&]()
+	{
+		if(packed.isEmpty())
+			return;
+		enqueueLoad(packed, chunk_size);
+		enqueueExtents(extents);
+		extents.clear();
+		packed.clear();
+	};
+
+	for(uint32_t address = start; address < end; address += 256)
+	{
+		QByteArray const page = data.mid(int(address - start), 256);
+		if(std::all_of(page.begin(), page.end(), [](char c) { return uint8_t(c) == 0xFF; })) {
+			skippedPages += 1;
+			continue;
+		}
+
+		if(uint32_t(packed.size()) + 256 > chunk_size)
+			flush();
+
+		uint32_t const work_offset = uint32_t(packed.size());
+		if(not extents.empty() and extents.back().flash_offset + extents.back().length == address)
+			extents.back().length += 256;
+		else
+			extents.push_back(Blaster::Extent { address, work_offset, 256 });
+		packed.append(page);
+	}
+	flush();
+}
+
+void FlashCommand::enqueueExtents(const std::vector<Blaster::Extent> & extents)
+{
+	if(not has_feature(features, Feature::SparseProgram))
+	{
+		for(auto const & extent : extents)
+			enqueueWrite(Blaster::program(extent.flash_offset, extent.work_offset, extent.length), extent.flash_offset, extent.length);
+		return;
+	}
+
+	for(size_t first = 0; first < extents.size(); first += Blaster::max_extents)
+	{
+		std::vector<Blaster::Extent> const list(
+			extents.begin() + int(first),
+			extents.begin() + int(std::min(extents.size(), first + Blaster::max_extents))
+		);
+
+		uint32_t length = 0;
+		for(auto const & extent : list)
+			length += extent.length;
+
+		Blaster::Request write;
+		write.packet = Blaster::program_list(list);
+		write.phase = "write";
+		write.bytes = length;
+		write.onReply = [this, list](Blaster::Reply const & reply)
+		{
+			if(not reply.ack) {
+				owner->logLine(QString("failed to write 0x%0 … 0x%1: %2 (%3)")
+					.arg(list.front().flash_offset, 8, 16, QChar('0'))
+					.arg(list.back().flash_offset + list.back().length - 1, 8, 16, QChar('0'))
+					.arg(Blaster::errorName(reply.error))
+					.arg(reply.info));
+				return false;
+			}
+			for(auto const & extent : list)
+				owner->logLine(QString("wrote 0x%0 … 0x%1")
+					.arg(extent.flash_offset, 8, 16, QChar('0'))
+					.arg(extent.flash_offset + extent.length - 1, 8, 16, QChar('0')));
+			record(list.back().flash_offset + list.back().length, FlashJournal::State::Written);
+			return true;
+		};
+		enqueue(std::move(write));
+	}
+}
+
+void FlashCommand::planSectorBatches(uint32_t start, const QByteArray & data, const SectorLayout & layout, uint32_t work_size)
+{
+	uint32_t const end = start + uint32_t(data.size());
+	bool const wide = has_feature(features, Feature::WideCommands);
+
+	// v1 commands have 16 bit lengths
+	uint32_t const max_load = wide ? work_size : std::min<uint32_t>(work_size, 0x8000);
+
+	uint32_t address = start;
+	while(address < end)
+	{
+		auto const first = layout.sectorOf(address);
+
+		// collect whole sectors as long as they fit into the work buffer,
+		// a sector must never be split between two batches as each batch
+		// erases all sectors it touches.
+		uint32_t batch_end = address;
+		for(size_t s = *first; s < layout.count() and layout[s].start_address < end; s++)
+		{
+			uint32_t const sector_end = std::min(layout[s].end_address(), end);
+			if(sector_end - address > work_size)
+				break;
+			batch_end = sector_end;
+		}
+		if(batch_end == address) {
+			error = QString("sector %0 does not fit into the work buffer").arg(*first);
+			return;
+		}
+
+		uint32_t const length = batch_end - address;
+		enqueueLoad(data.mid(int(address - start), int(length)), max_load);
+		enqueueWrite(Blaster::erase_and_write(wide, address, 0, length), address, length);
+
+		address = batch_end;
+	}
+}
+
+void FlashCommand::enqueueLoad(const QByteArray & chunk, uint32_t max_load)
+{
+	uint32_t const length = uint32_t(chunk.size());
+	for(uint32_t offset = 0; offset < length; offset += max_load)
+	{
+		auto load = Blaster::load_request(offset, chunk.mid(int(offset), int(std::min(max_load, length - offset))));
+		load.phase = "load";
+		enqueue(std::move(load));
+	}
+}
+
+void FlashCommand::enqueueWrite(QByteArray && packet, uint32_t address, uint32_t length)
+{
+	Blaster::Request write;
+	write.packet = std::move(packet);
+	write.phase = "write";
+	write.bytes = length;
+	write.onReply = [this, address, length](Blaster::Reply const & reply)
+	{
+		if(not reply.ack) {
+			owner->logLine(QString("failed to write 0x%0: %1 (%2)")
+				.arg(address, 8, 16, QChar('0'))
+				.arg(Blaster::errorName(reply.error))
+				.arg(reply.info));
+			return false;
+		}
+		owner->logLine(QString("wrote 0x%0 … 0x%1")
+			.arg(address, 8, 16, QChar('0'))
+			.arg(address + length - 1, 8, 16, QChar('0')));
+		record(address + length, FlashJournal::State::Written);
+		return true;
+	};
+	enqueue(std::move(write));
+}
+
+void FlashCommand::record(uint32_t to, FlashJournal::State state)
+{
+	if(not journal)
+		return;
+	// extents and batches are written in ascending order, so everything
+	// below `to` is done
+	if(requests.empty() and finishesJournal)
+		journal->finish();
+	else
+		journal->mark(firstAddress, to, state);
+}
+
+void FlashCommand::onInit()
+{
+	if(not error.isEmpty()) {
+		owner->logLine("cannot program image: " + error);
+		return done(false);
+	}
+	if(skippedPages > 0)
+		owner->logLine(QString("skipping %0 erased pages").arg(skippedPages));
+	SequenceCommand::onInit();
+}
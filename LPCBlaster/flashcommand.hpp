@@ -0,0 +1,60 @@
+#ifndef FLASHCOMMAND_HPP
+#define FLASHCOMMAND_HPP
+
+#include "blaster.hpp"
+#include "flashjournal.hpp"
+#include "sectorlayout.hpp"
+
+//! Programs an image into the flash of the controller.
+//!
+//! If the blaster supports Feature::ProgramOnly, all touched sectors are
+//! erased up front. Pages that are completely 0xFF are already in that state
+//! then, so only the other pages are packed into the work buffer and written
+//! without erasing.
+//! Otherwise the image is split into batches of whole sectors that fit into
+//! the work buffer, each batch is loaded and then erased and written in one go.
+//!
+//! If `journal` is set, the erased and written sectors are recorded in it.
+struct FlashCommand : Blaster::SequenceCommand
+{
+	QString error;
+	uint32_t features;
+	int skippedPages = 0;
+	FlashJournal * journal = nullptr;
+
+	//! The journal record is removed after the last request. Off for all
+	//! but the last of several commands that program one image.
+	bool finishesJournal = true;
+
+	explicit FlashCommand(
+		uint32_t base_address,
+		QByteArray const & image,
+		SectorLayout const & layout,
+		uint32_t features,
+		uint32_t work_size
+	);
+
+	void onInit() override;
+
+private:
+	void planEraseFirst(uint32_t start, QByteArray const & data, SectorLayout const & layout, uint32_t work_size);
+
+	void planSectorBatches(uint32_t start, QByteArray const & data, SectorLayout const & layout, uint32_t work_size);
+
+	//! Loads `chunk` to the start of the work buffer. Gaps and padding
+	//! are sent as fill or run length encoded if the blaster supports it.
+	void enqueueLoad(QByteArray const & chunk, uint32_t max_load);
+
+	void enqueueWrite(QByteArray && packet, uint32_t address, uint32_t length);
+
+	//! Everything from the start up to `to` reached `state`. Finishes the
+	//! journal record after the last request.
+	void record(uint32_t to, FlashJournal::State state);
+
+	uint32_t firstAddress = 0;
+
+	//! Writes the extents of the work buffer, with P if possible.
+	void enqueueExtents(std::vector<Blaster::Extent> const & extents);
+};
+
+#endif // FLASHCOMMAND_HPP
@@ -0,0 +1,206 @@
+#include "flashjournal.hpp"
+
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <algorithm>
+
+static char const * const state_names[] = { "pending", "erased", "written", "verified" };
+
+static QJsonObject read_journal(QString const & fileName)
+{
+	QFile file(fileName);
+	if(not file.open(QFile::ReadOnly))
+		return QJsonObject();
+	return QJsonDocument::fromJson(file.readAll()).object();
+}
+
+static void write_journal(QString const & fileName, QJsonObject const & journal)
+{
+	QSaveFile file(fileName);
+	if(not file.open(QFile::WriteOnly)) {
+		qDebug() << "failed to write flash journal";
+		return;
+	}
+	file.write(QJsonDocument(journal).toJson());
+	file.commit();
+}
+
+static QByteArray image_hash(QByteArray const & image, uint32_t start)
+{
+	QCryptographicHash hash(QCryptographicHash::Sha256);
+	hash.addData(reinterpret_cast<char const *>(&start), sizeof start);
+	hash.addData(image);
+	return hash.result().toHex();
+}
+
+FlashJournal::FlashJournal(QString fileName) :
+  fileName(std::move(fileName))
+{
+
+}
+
+bool FlashJournal::begin(const QString & device, const QByteArray & image, uint32_t start, const SectorLayout & layout)
+{
+	this->device = device;
+	this->hash = image_hash(image, start);
+	this->start = start;
+	this->length = uint32_t(image.size());
+	this->layout = layout;
+
+	states.clear();
+	auto const first = layout.sectorOf(start);
+	auto const last = layout.sectorOf(start + length - 1);
+	if(device.isEmpty() or length == 0 or not first or not last) {
+		this->device.clear();
+		return false;
+	}
+	firstSector = *first;
+	states.assign(*last - *first + 1, State::Pending);
+
+	auto const record = read_journal(fileName).value(device).toObject();
+	if(record.value("image").toString().toUtf8() != hash)
+		return false;
+
+	auto const list = record.value("sectors").toArray();
+	if(list.size() != int(states.size()))
+		return false;
+
+	bool resumable = false;
+	for(size_t i = 0; i < states.size(); i++)
+	{
+		auto const name = list.at(int(i)).toString();
+		auto const it = std::find_if(std::begin(state_names), std::end(state_names), [&](char const * s) { return name == s; });
+		if(it == std::end(state_names))
+			return false;
+		states[i] = State(it - std::begin(state_names));
+		resumable |= (states[i] != State::Pending);
+	}
+	return resumable;
+}
+
+std::pair<uint32_t, uint32_t> FlashJournal::rangeOf(size_t index) const
+{
+	auto const & sector = layout[firstSector + index];
+	return std::make_pair(
+		std::max(sector.start_address, start),
+		std::min(sector.end_address(), start + length)
+	);
+}
+
+void FlashJournal::mark(uint32_t from, uint32_t to, State state)
+{
+	if(not isActive())
+		return;
+
+	bool changed = false;
+	for(size_t i = 0; i < states.size(); i++)
+	{
+		auto const [ first, last ] = rangeOf(i);
+		if(first >= from and last <= to and states[i] != state) {
+			states[i] = state;
+			changed = true;
+		}
+	}
+	if(changed)
+		save();
+}
+
+void FlashJournal::markUntouched(const std::vector<size_t> & touched)
+{
+	if(not isActive())
+		return;
+
+	bool changed = false;
+	for(size_t i = 0; i < states.size(); i++)
+	{
+		if(std::find(touched.begin(), touched.end(), firstSector + i) != touched.end())
+			continue;
+		if(states[i] != State::Verified) {
+			states[i] = State::Verified;
+			changed = true;
+		}
+	}
+	if(changed)
+		save();
+}
+
+void FlashJournal::verify(const QByteArray & image, uint32_t from, const QByteArray & flash)
+{
+	if(not isActive())
+		return;
+
+	uint32_t const to = from + uint32_t(flash.size());
+	uint32_t verified = from;
+	for(size_t i = 0; i < states.size(); i++)
+	{
+		auto const [ first, last ] = rangeOf(i);
+		if(first < from or last > to)
+			continue;
+		int const n = int(last - first);
+		if(flash.mid(int(first - from), n) != image.mid(int(first - start), n))
+			break;
+		verified = last;
+	}
+	mark(from, verified, State::Verified);
+}
+
+void FlashJournal::finish()
+{
+	if(not isActive())
+		return;
+
+	auto journal = read_journal(fileName);
+	journal.remove(device);
+	write_journal(fileName, journal);
+
+	device.clear();
+	states.clear();
+}
+
+uint32_t FlashJournal::resumeAddress() const
+{
+	for(size_t i = 0; i < states.size(); i++)
+	{
+		if(states[i] != State::Verified)
+			return rangeOf(i).first;
+	}
+	return start + length;
+}
+
+std::pair<uint32_t, uint32_t> FlashJournal::unverifiedRange() const
+{
+	uint32_t const from = resumeAddress();
+	uint32_t to = from;
+	for(size_t i = 0; i < states.size(); i++)
+	{
+		auto const [ first, last ] = rangeOf(i);
+		if(first < from)
+			continue;
+		if(states[i] != State::Written)
+			break;
+		to = last;
+	}
+	return std::make_pair(from, to);
+}
+
+void FlashJournal::save() const
+{
+	QJsonArray list;
+	for(auto const state : states)
+		list.append(state_names[int(state)]);
+
+	QJsonObject record;
+	record["image"] = QString::fromUtf8(hash);
+	record["start"] = qint64(start);
+	record["length"] = qint64(length);
+	record["sectors"] = list;
+
+	auto journal = read_journal(fileName);
+	journal[device] = record;
+	write_journal(fileName, journal);
+}
@@ -0,0 +1,76 @@
+#ifndef FLASHJOURNAL_HPP
+#define FLASHJOURNAL_HPP
+
+#include "sectorlayout.hpp"
+
+#include <QByteArray>
+#include <QString>
+#include <utility>
+
+//! Records which sectors of an image were erased, written and verified,
+//! so programming can be resumed after the connection was lost.
+//!
+//! The journal holds one record per device, keyed by the device identity
+//! and the hash of the image. It is saved to `fileName` after every change
+//! and the record is removed when the image is completely programmed.
+class FlashJournal
+{
+public:
+	enum class State
+	{
+		Pending,
+		Erased,
+		Written,
+		Verified,
+	};
+
+private:
+	QString fileName;
+	QString device;
+	QByteArray hash;
+	uint32_t start = 0;
+	uint32_t length = 0;
+	SectorLayout layout;
+	size_t firstSector = 0;
+	std::vector<State> states;
+
+public:
+	explicit FlashJournal(QString fileName = "LPCBlaster-journal.json");
+
+	//! Starts recording the programming of `image` at `start` on `device`.
+	//! Returns true if an unfinished record of the same image exists, its
+	//! progress is kept then. Nothing is recorded if `device` is empty.
+	bool begin(QString const & device, QByteArray const & image, uint32_t start, SectorLayout const & layout);
+
+	bool isActive() const { return not device.isEmpty(); }
+
+	//! Sets all sectors whose part of the image lies inside [from, to) to `state`.
+	void mark(uint32_t from, uint32_t to, State state);
+
+	//! Sets all sectors except the layout indices in `touched` to Verified,
+	//! the others already hold the image or are gaps between images.
+	void markUntouched(std::vector<size_t> const & touched);
+
+	//! Compares each sector in `flash`, which was read from `from`, with the
+	//! image and marks the sectors verified up to the first mismatch.
+	void verify(QByteArray const & image, uint32_t from, QByteArray const & flash);
+
+	//! Removes the record, the image is completely programmed.
+	void finish();
+
+	//! First address of the image that is not verified, the end of the image
+	//! if everything is verified.
+	uint32_t resumeAddress() const;
+
+	//! Range [from, to) behind resumeAddress() that was written, but not
+	//! verified. Empty if nothing has to be verified before resuming.
+	std::pair<uint32_t, uint32_t> unverifiedRange() const;
+
+private:
+	//! Part of sector `index` (relative to firstSector) that belongs to the image.
+	std::pair<uint32_t, uint32_t> rangeOf(size_t index) const;
+
+	void save() const;
+};
+
+#endif // FLASHJOURNAL_HPP
@@ -0,0 +1,25 @@
+#include "hashcommand.hpp"
+
+HashCommand::HashCommand(size_t first, size_t count)
+{
+	Blaster::Request request;
+	request.packet = Blaster::hash_sectors(uint8_t(first), uint8_t(count));
+	request.phase = "hash";
+	request.payloadSize = [count](QByteArray const &) { return 4 * int(count); };
+	request.onReply = [this, count](Blaster::Reply const & reply)
+	{
+		if(not reply.ack) {
+			owner->logLine(QString("failed to read sector hashes: %0 (%1)")
+				.arg(Blaster::errorName(reply.error))
+				.arg(reply.info));
+			return false;
+		}
+		std::vector<uint32_t> hashes;
+		for(size_t i = 0; i < count; i++)
+			hashes.push_back(Blaster::extract<uint32_t>(reply.payload, int(4 * i)));
+		if(consumer)
+			consumer(hashes);
+		return true;
+	};
+	enqueue(std::move(request));
+}
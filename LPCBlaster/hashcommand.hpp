@@ -0,0 +1,15 @@
+#ifndef HASHCOMMAND_HPP
+#define HASHCOMMAND_HPP
+
+#include "blaster.hpp"
+
+//! Reads the CRC-32 of the sectors [first, first+count) with H.
+struct HashCommand : Blaster::SequenceCommand
+{
+	//! Receives the hashes if the blaster sent them.
+	std::function<void(std::vector<uint32_t> const &)> consumer;
+
+	explicit HashCommand(size_t first, size_t count);
+};
+
+#endif // HASHCOMMAND_HPP
@@ -0,0 +1,73 @@
+#include "imagediff.hpp"
+
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+size_t ImageDiff::mismatch(const uint8_t * a, const uint8_t * b, size_t size, size_t from)
+{
+	size_t i = from;
+
+#if defined(__AVX2__)
+	for(; i + 32 <= size; i += 32)
+	{
+		__m256i const va = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(a + i));
+		__m256i const vb = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(b + i));
+		uint32_t const differ = ~uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb)));
+		if(differ != 0)
+			return i + size_t(__builtin_ctz(differ));
+	}
+#endif
+
+#if defined(__SSE2__)
+	for(; i + 16 <= size; i += 16)
+	{
+		__m128i const va = _mm_loadu_si128(reinterpret_cast<__m128i const *>(a + i));
+		__m128i const vb = _mm_loadu_si128(reinterpret_cast<__m128i const *>(b + i));
+		uint32_t const differ = ~uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb))) & 0xFFFFU;
+		if(differ != 0)
+			return i + size_t(__builtin_ctz(differ));
+	}
+#endif
+
+	for(; i < size; i++)
+	{
+		if(a[i] != b[i])
+			return i;
+	}
+	return size;
+}
+
+std::vector<uint32_t> ImageDiff::differingPages(const QByteArray & a, const QByteArray & b, uint32_t page_size)
+{
+	size_t const common = size_t(std::min(a.size(), b.size()));
+	size_t const total = size_t(std::max(a.size(), b.size()));
+	auto const * pa = reinterpret_cast<uint8_t const *>(a.constData());
+	auto const * pb = reinterpret_cast<uint8_t const *>(b.constData());
+
+	std::vector<uint32_t> pages;
+	size_t position = 0;
+	while(true)
+	{
+		// skip to the next difference, the rest of its page needs no compare
+		position = mismatch(pa, pb, common, position);
+		if(position >= common)
+			break;
+		pages.push_back(uint32_t(position / page_size));
+		position = (position / page_size + 1) * page_size;
+	}
+
+	if(total > common)
+	{
+		for(size_t page = common / page_size; page * page_size < total; page++)
+		{
+			if(pages.empty() or pages.back() < page)
+				pages.push_back(uint32_t(page));
+		}
+	}
+	return pages;
+}
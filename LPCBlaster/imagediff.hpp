@@ -0,0 +1,21 @@
+#ifndef IMAGEDIFF_HPP
+#define IMAGEDIFF_HPP
+
+#include <QByteArray>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace ImageDiff
+{
+	//! Returns the index of the first byte at or after `from` in which
+	//! `a` and `b` differ, or `size` if they are equal.
+	//! Compares 32 (AVX2) or 16 (SSE2) bytes at once if available.
+	size_t mismatch(uint8_t const * a, uint8_t const * b, size_t size, size_t from = 0);
+
+	//! Returns the indices of the pages of `page_size` bytes in which
+	//! `a` and `b` differ. Bytes behind the shorter array count as different.
+	std::vector<uint32_t> differingPages(QByteArray const & a, QByteArray const & b, uint32_t page_size = 256);
+}
+
+#endif // IMAGEDIFF_HPP
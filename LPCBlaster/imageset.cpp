@@ -0,0 +1,137 @@
+#include "imageset.hpp"
+#include "elfloader.hpp"
+
+#include <QFile>
+#include <QStringList>
+#include <algorithm>
+#include <cstring>
+
+ImageSet ImageSet::load(const QString & spec)
+{
+	ImageSet set;
+	for(auto const & entry : spec.split(';', Qt::SkipEmptyParts))
+	{
+		auto const item = entry.trimmed();
+		int const at = item.lastIndexOf('@');
+
+		Part part;
+		if(at < 0)
+		{
+			part.fileName = item;
+			auto const image = ELFLoader::load_image(part.fileName);
+			if(not image) {
+				set.error = "failed to load image " + part.fileName;
+				return set;
+			}
+			part.data = std::get<0>(*image);
+			part.start = std::get<1>(*image);
+		}
+		else
+		{
+			part.fileName = item.left(at);
+			bool ok;
+			part.start = item.mid(at + 1).toUInt(&ok, 0);
+			QFile file(part.fileName);
+			if(not ok or not file.open(QFile::ReadOnly)) {
+				set.error = "failed to load image " + item;
+				return set;
+			}
+			part.data = file.readAll();
+		}
+		if(part.data.isEmpty()) {
+			set.error = "image " + part.fileName + " is empty";
+			return set;
+		}
+		set.parts.push_back(std::move(part));
+	}
+
+	if(set.parts.empty()) {
+		set.error = "no image selected";
+		return set;
+	}
+
+	std::sort(set.parts.begin(), set.parts.end(), [](Part const & a, Part const & b) {
+		return a.start < b.start;
+	});
+	for(size_t i = 1; i < set.parts.size(); i++)
+	{
+		auto const & a = set.parts[i - 1];
+		auto const & b = set.parts[i];
+		if(b.start < a.end()) {
+			set.error = QString("%0 (0x%1 … 0x%2) overlaps %3 (0x%4 … 0x%5)")
+				.arg(b.fileName).arg(b.start, 8, 16, QChar('0')).arg(b.end() - 1, 8, 16, QChar('0'))
+				.arg(a.fileName).arg(a.start, 8, 16, QChar('0')).arg(a.end() - 1, 8, 16, QChar('0'));
+			return set;
+		}
+	}
+	return set;
+}
+
+uint32_t ImageSet::start() const
+{
+	return parts.front().start;
+}
+
+uint32_t ImageSet::end() const
+{
+	uint32_t end = 0;
+	for(auto const & part : parts)
+		end = std::max(end, part.end());
+	return end;
+}
+
+QByteArray ImageSet::merged() const
+{
+	QByteArray image(int(end() - start()), char(0xFF));
+	for(auto const & part : parts)
+		memcpy(image.data() + (part.start - start()), part.data.constData(), size_t(part.data.size()));
+	return image;
+}
+
+std::vector<size_t> ImageSet::sectors(const SectorLayout & layout) const
+{
+	std::vector<size_t> list;
+	for(auto const & part : parts)
+	{
+		auto const first = layout.sectorOf(part.start);
+		auto const last = layout.sectorOf(part.end() - 1);
+		if(not first or not last)
+			continue;
+		for(size_t s = *first; s <= *last; s++)
+		{
+			if(list.empty() or list.back() < s)
+				list.push_back(s);
+		}
+	}
+	return list;
+}
+
+std::vector<size_t> ImageSet::partialSectors(const SectorLayout & layout) const
+{
+	std::vector<size_t> list;
+	for(size_t s : sectors(layout))
+	{
+		uint32_t covered = 0;
+		for(auto const & part : parts)
+		{
+			uint32_t const from = std::max(part.start, layout[s].start_address);
+			uint32_t const to = std::min(part.end(), layout[s].end_address());
+			if(from < to)
+				covered += to - from;
+		}
+		if(covered < layout[s].length)
+			list.push_back(s);
+	}
+	return list;
+}
+
+void ImageSet::fillGaps(QByteArray & image, const QByteArray & flash) const
+{
+	uint32_t position = start();
+	for(auto const & part : parts)
+	{
+		if(part.start > position)
+			memcpy(image.data() + (position - start()), flash.constData() + (position - start()), part.start - position);
+		position = part.end();
+	}
+}
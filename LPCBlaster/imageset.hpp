@@ -0,0 +1,54 @@
+#ifndef IMAGESET_HPP
+#define IMAGESET_HPP
+
+#include "sectorlayout.hpp"
+
+#include <QByteArray>
+#include <QString>
+#include <vector>
+
+//! Several images that are programmed in one session, like a bootloader,
+//! an application and a config blob.
+//!
+//! The images are given as a list separated by ';'. ELF files are placed at
+//! their load address, other files need an address: `config.bin@0x78000`.
+class ImageSet
+{
+public:
+	struct Part
+	{
+		QString fileName;
+		uint32_t start;
+		QByteArray data;
+
+		uint32_t end() const { return start + uint32_t(data.size()); }
+	};
+
+	//! Parts sorted by their start address.
+	std::vector<Part> parts;
+
+	//! Set if loading failed or parts overlap.
+	QString error;
+
+	static ImageSet load(QString const & spec);
+
+	uint32_t start() const;
+
+	uint32_t end() const;
+
+	//! All parts merged into one image from start() to end(), the gaps
+	//! between the parts are 0xFF.
+	QByteArray merged() const;
+
+	//! Sectors that contain at least one byte of a part.
+	std::vector<size_t> sectors(SectorLayout const & layout) const;
+
+	//! Those of sectors() that also hold flash outside the parts, so they
+	//! can't be erased without losing it.
+	std::vector<size_t> partialSectors(SectorLayout const & layout) const;
+
+	//! Copies the gaps between the parts from `flash`, which was read from start().
+	void fillGaps(QByteArray & image, QByteArray const & flash) const;
+};
+
+#endif // IMAGESET_HPP
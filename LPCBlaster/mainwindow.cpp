@@ -11,7 +11,19 @@
 #include <QTimer>
 #include <QFile>
 
+#include <QFileDialog>
+#include <algorithm>
+#include <iterator>
+
 #include <elfloader.hpp>
+#include "blaster.hpp"
+#include "flashcommand.hpp"
+#include "readbackcommand.hpp"
+#include "hashcommand.hpp"
+#include "imagediff.hpp"
+#include "imageset.hpp"
+#include "patchcommand.hpp"
+#include "stage0command.hpp"
 
 namespace UU
 {
@@ -130,9 +142,16 @@ MainWindow::MainWindow(QWidget *parent) :
 	stateLabel = new QLabel(this);
 	ui->statusBar->addWidget(stateLabel);
 
-	connect(&port, &QSerialPort::readyRead, this, &MainWindow::on_port_ready);
-	connect(&port, &QSerialPort::errorOccurred, this, [](QSerialPort::SerialPortError err) {
-		qDebug() << "serial port error:" << err;
+	syncSettings = SyncSettings::load("LPCBlaster.ini");
+	timeouts = CommandTimeouts::load("LPCBlaster.ini");
+	packetSizer.configure("LPCBlaster.ini");
+	syncTimer.setSingleShot(true);
+	connect(&syncTimer, &QTimer::timeout, this, [this]() {
+		auto action = std::move(syncAction);
+		syncAction = nullptr;
+		if(action)
+			action();
+		updateUI();
 	});
 
 	// get new port list and refresh the UI
@@ -146,27 +165,108 @@ MainWindow::~MainWindow()
 
 void MainWindow::enableBootloader(bool enabled)
 {
-	port.setRequestToSend(enabled); // BOOT ENA
+	port->setRequestToSend(enabled); // BOOT ENA
 }
 
 void MainWindow::enableReset(bool reset)
 {
-	port.setDataTerminalReady(reset);
+	port->setDataTerminalReady(reset);
 }
 
 bool MainWindow::connectToISP()
 {
+	finishSession();
+	deviceIdentity.clear();
+
+	// the stage 0 loader may have switched to a faster baud rate,
+	// the ISP always starts with autobauding at 115200
+	port->setBaudRate(115200);
+	port->setFlowControl(QSerialPort::SoftwareControl);
+
+	report.start(port->name(), port->baudRate());
+	report.beginPhase("sync");
+	connectTimer.start();
+
+	// The ISP may still be synchronized from the last connect. Disabling
+	// the echo is harmless and answers with a single line, so use it to
+	// check if the handshake can be skipped.
+	if(state == ConnectionEstablished and syncSettings.probeTimeoutMs > 0)
+	{
+		state = WaitForProbe;
+		port->clear();
+		port->write("A 0\r\n");
+		scheduleSync(syncSettings.probeTimeoutMs, [this]() {
+			resetIntoISP(0);
+		});
+		return true;
+	}
+
+	resetIntoISP(0);
+	return true;
+}
+
+void MainWindow::scheduleSync(int ms, std::function<void()> && action)
+{
+	syncAction = std::move(action);
+	syncTimer.start(ms);
+}
+
+void MainWindow::resetIntoISP(int attempt)
+{
+	syncAttempt = attempt;
+	state = ResettingTarget;
+
 	enableBootloader(true);
 	enableReset(true);
-	QThread::msleep(100);
-	enableReset(false);
-	QThread::msleep(100);
+	scheduleSync(syncSettings.resetPulseMs, [this]() {
+		enableReset(false);
+		scheduleSync(syncSettings.backoff(syncSettings.bootDelayMs, syncAttempt), [this]() {
+			state = WaitForInitialSynchronized;
+			port->clear(); // flush FIFOs
+			port->write("?");
+			armSyncTimeout();
+		});
+	});
+}
+
+void MainWindow::armSyncTimeout()
+{
+	scheduleSync(syncSettings.backoff(syncSettings.responseTimeoutMs, syncAttempt), [this]() {
+		retrySync();
+	});
+}
 
-	state = WaitForInitialSynchronized;
-	port.clear(); // flush FIFOs
-	port.write("?");
+void MainWindow::retrySync()
+{
+	if(syncAttempt + 1 >= syncSettings.maxAttempts)
+	{
+		logLine(QString("no answer from the ISP after %0 attempts").arg(syncAttempt + 1));
+		report.endPhase(false);
+		state = PortOpen;
+		return;
+	}
+	qDebug() << "no answer from the ISP, resetting again";
+	report.addRetry();
+	resetIntoISP(syncAttempt + 1);
+}
 
-	return true;
+void MainWindow::syncFinished()
+{
+	syncTimer.stop();
+	syncAction = nullptr;
+	report.endPhase();
+	state = ConnectionEstablished;
+	logLine(QString("connected to ISP in %0 ms").arg(connectTimer.elapsed()));
+}
+
+void MainWindow::finishSession()
+{
+	if(not report.isActive())
+		return;
+	report.finish();
+	logLine(report.summary());
+	if(not report.append("LPCBlaster-report.jsonl"))
+		qDebug() << "failed to write session report";
 }
 
 void MainWindow::on_connectButton_clicked()
@@ -178,14 +278,14 @@ void MainWindow::on_connectButton_clicked()
 
 void MainWindow::on_sendButton_clicked()
 {
-	port.write(ui->message->text().toUtf8());
-	port.write("\r\n");
+	port->write(ui->message->text().toUtf8());
+	port->write("\r\n");
 	updateUI();
 }
 
 void MainWindow::on_port_ready()
 {
-	while(not port.atEnd())
+	while(not port->atEnd())
 	{
 		if(not process_port_data())
 			break;
@@ -197,14 +297,34 @@ bool MainWindow::process_port_data()
 {
 	switch(state)
 	{
+		case ResettingTarget:
+			// garbage while the target is held in reset
+			port->readAll();
+			return true;
+
+		case WaitForProbe:
+		{
+			if(not port->canReadLine())
+				return false;
+			auto line = port->readLine();
+			if(line == "0\r\n") {
+				qDebug() << "ISP is still synchronized";
+				syncFinished();
+			} else {
+				qDebug() << "wfp" << line;
+			}
+			return true;
+		}
+
 		case WaitForInitialSynchronized:
 		{
-			if(not port.canReadLine())
+			if(not port->canReadLine())
 				return false;
-			auto line = port.readLine();
+			auto line = port->readLine();
 			if(line == "Synchronized\r\n") {
-				port.write("Synchronized\r\n");
+				port->write("Synchronized\r\n");
 				state = WaitForInitialOK;
+				armSyncTimeout();
 				qDebug() << "initial synchronize received";
 			} else {
 				qDebug() << "wfis" << line;
@@ -214,12 +334,13 @@ bool MainWindow::process_port_data()
 		}
 		case WaitForInitialOK:
 		{
-			if(not port.canReadLine())
+			if(not port->canReadLine())
 				return false;
-			auto line = port.readLine();
+			auto line = port->readLine();
 			if(line == "Synchronized\rOK\r\n") {
-				port.write("12000\r\n");
+				port->write(syncSettings.crystalKHz + "\r\n");
 				state = WaitForFrequencyOK;
+				armSyncTimeout();
 				qDebug() << "initial ok received";
 			} else {
 				qDebug() << "wfio" << line;
@@ -230,12 +351,13 @@ bool MainWindow::process_port_data()
 
 		case WaitForFrequencyOK:
 		{
-			if(not port.canReadLine())
+			if(not port->canReadLine())
 				return false;
-			auto line = port.readLine();
-			if(line == "12000\rOK\r\n") {
-				port.write("A 0\r\n");
+			auto line = port->readLine();
+			if(line == syncSettings.crystalKHz + "\rOK\r\n") {
+				port->write("A 0\r\n");
 				state = WaitForEchoACK;
+				armSyncTimeout();
 				qDebug() << "frequency set: ok";
 			} else {
 				qDebug() << "wffo" << line;
@@ -245,12 +367,12 @@ bool MainWindow::process_port_data()
 
 		case WaitForEchoACK:
 		{
-			if(not port.canReadLine())
+			if(not port->canReadLine())
 				return false;
-			auto line = port.readLine();
+			auto line = port->readLine();
 			if(line == "A 0\r0\r\n") {
 				qDebug() << "echo disabled, connection established";
-				state = ConnectionEstablished;
+				syncFinished();
 			} else {
 				qDebug() << "wfea" << line;
 			}
@@ -260,113 +382,15 @@ bool MainWindow::process_port_data()
 		case PortOpen:
 		case ConnectionEstablished:
 		case LPCBlasterReady:
-			log(port.readAll());
+			log(port->readAll());
 			return true;
 
 		case CommandStarted:
 			assert(this->currentCommand);
 			return this->currentCommand->onData();
 
-		case LPCBlasterTransfer:
-		{
-			auto data = port.read(1);
-			if(data.isEmpty())
-				return false;
-			assert(data.size() == 1);
-			assert(data[0] == '\006' or data[0] == '\025');
-			if(data[0] == '\006') {
-				if(readback)
-					state = LPCBlasterReadbackData;
-				else
-					state = LPCBlasterReady;
-			}
-			else {
-				state = LPCBlasterError;
-			}
-			return true;
-		}
-
-		case LPCBlasterError:
-		{
-			auto data = port.peek(2);
-			if(data.size() < 2)
-				return false;
-			data = port.read(2);
-			assert(data.size() == 2);
-
-			static char const * const error_names[] =
-			{
-			  "Unknown State",
-			  "Invalid Length",
-				"Invalid Checksum",
-				"Out Of Range",
-				"Not Aligned",
-				"IAP Failure",
-				"Unknown Command",
-			};
-
-			logLine(QString("LPCBlaster returned error: %0 (%1)").arg(error_names[data[0]]).arg(uint8_t(data[1])));
-
-			state = LPCBlasterReady;
-			return true;
-		}
-
-		case LPCBlasterReadbackData:
-		{
-			assert(readback);
-			auto & data = *readback;
-
-			int rest = data.length - data.buffer.size();
-			assert(rest > 0);
-
-			auto newData = port.read(rest);
-			assert(newData.size() <= rest);
-			data.buffer.append(newData);
-
-			data.progress->setValue(100 * data.buffer.size() / data.length);
-
-			qDebug() << "received" << newData.size() << "bytes, summing up to" << data.buffer.size();
-
-			if(data.buffer.size() == data.length)
-			{
-				dumpHex(data.buffer, data.offset);
-				state = LPCBlasterReadbackChecksum;
-			}
-
-			return true;
-		}
-
-		case LPCBlasterReadbackChecksum:
-		{
-			assert(readback);
-			assert(readback->buffer.size() == readback->length);
-
-			auto cs_data = port.read(2);
-			if(cs_data.size() < 2) {
-				if(cs_data.size() == 1)
-					port.ungetChar(cs_data[0]);
-				return false;
-			}
-			assert(cs_data.size() == 2);
-
-			uint16_t remote_checksum = *reinterpret_cast<uint16_t const *>(cs_data.data());
-			uint16_t local_checksum = 0;
-			for(uint8_t c : readback->buffer)
-				local_checksum += c;
-
-			if(local_checksum != remote_checksum)
-				logLine(QString("checksum: bad (%0 != %1)").arg(local_checksum).arg(remote_checksum));
-			else
-				logLine(QString("checksum: good"));
-
-			state = LPCBlasterReady;
-			readback.reset();
-
-			return true;
-		}
-
 		default:
-			qDebug() << "unknown state" << int(state) << ":" << port.readAll();
+			qDebug() << "unknown state" << int(state) << ":" << port->readAll();
 			return true;
 	}
 	assert(false);
@@ -374,12 +398,12 @@ bool MainWindow::process_port_data()
 
 void MainWindow::updateUI()
 {
-	bool const isOpen = port.isOpen();
+	bool const isOpen = port and port->isOpen();
 
 	ui->refreshPortListButton->setEnabled(not isOpen);
 	ui->portList->setEnabled(not isOpen);
 
-	ui->openComButton->setEnabled(ui->portList->currentIndex() >= 0);
+	ui->openComButton->setEnabled(isOpen or not portAddress().isEmpty());
 	ui->openComButton->setText(isOpen ? "Close" :  "Open");
 
 	ui->connectButton->setEnabled(isOpen);
@@ -395,6 +419,7 @@ void MainWindow::updateUI()
 
 	ui->blasterTabs->setEnabled(isOpen and state == LPCBlasterReady);
 
+
 	{
 		QString stateText = "Disconnected";
 		if(isOpen)
@@ -402,6 +427,8 @@ void MainWindow::updateUI()
 			switch(state)
 			{
 				case PortOpen:                   stateText = "Port openend"; break;
+				case ResettingTarget:            stateText = "Resetting…"; break;
+				case WaitForProbe:               stateText = "Checking connection…"; break;
 				case WaitForInitialSynchronized: stateText = "Waiting for synchronization…"; break;
 				case WaitForInitialOK:           stateText = "Waiting for ok…"; break;
 				case WaitForFrequencyOK:         stateText = "Setting frequency…"; break;
@@ -409,10 +436,6 @@ void MainWindow::updateUI()
 				case ConnectionEstablished:      stateText = "Connected"; break;
 				case CommandStarted:             stateText = "Executing command…"; break;
 				case LPCBlasterReady:            stateText = "LPCBlaster ready"; break;
-				case LPCBlasterTransfer:         stateText = "LPCBlaster working…"; break;
-				case LPCBlasterError:            stateText = "Waiting for LPCBlaster error…"; break;
-				case LPCBlasterReadbackData:     stateText = "LPCBlaster transferring data…"; break;
-				case LPCBlasterReadbackChecksum: stateText = "LPCBlaster transferring data…"; break;
 			}
 		}
 		stateLabel->setText(stateText);
@@ -474,11 +497,14 @@ void MainWindow::logLine(const QString & str)
 
 void MainWindow::on_resetButton_clicked()
 {
+	finishSession();
 	enableBootloader(false);
 	enableReset(true);
-	QThread::msleep(100);
-	enableReset(false);
-	state = PortOpen;
+	state = ResettingTarget;
+	scheduleSync(syncSettings.resetPulseMs, [this]() {
+		enableReset(false);
+		state = PortOpen;
+	});
 	updateUI();
 }
 
@@ -488,43 +514,51 @@ void MainWindow::on_encodeTestButton_clicked()
 
 void MainWindow::on_openComButton_clicked()
 {
-	if(port.isOpen())
+	if(port and port->isOpen())
 	{
-		port.close();
+		syncTimer.stop();
+		syncAction = nullptr;
+		finishSession();
+		port->close();
 	}
 	else
 	{
-		port.setPortName("/dev/" + ui->portList->currentData().toString());
-		bool ok = port.open(QSerialPort::ReadWrite);
-		if(ok)
+		port = Transport::create(portAddress());
+		connect(&port->device(), &QIODevice::readyRead, this, &MainWindow::on_port_ready);
+		if(not port->open())
 		{
-			bool good = true;
-			good &= port.setBaudRate(115200);
-			good &= port.setDataBits(QSerialPort::Data8);
-			good &= port.setStopBits(QSerialPort::OneStop);
-			good &= port.setParity(QSerialPort::NoParity);
-			good &= port.setFlowControl(QSerialPort::SoftwareControl);
-
-			port.setReadBufferSize(1 << 20); // 1 MB
-
-			assert(good);
-
+			logLine(QString("cannot open %0: %1").arg(port->name()).arg(port->errorString()));
+			port.reset();
+		}
+		else
+		{
+			packetSizer.select(port->name());
 			enableBootloader(false);
 			enableReset(false);
-			port.clear(); // flush FIFOs
+			port->clear(); // flush FIFOs
 			state = PortOpen;
 		}
 	}
 	updateUI();
 }
 
+QString MainWindow::portAddress() const
+{
+	// typed addresses (tcp://host:port) have no item data
+	int const index = ui->portList->currentIndex();
+	if(index >= 0 and ui->portList->itemText(index) == ui->portList->currentText())
+		return ui->portList->currentData().toString();
+	return ui->portList->currentText().trimmed();
+}
+
 void MainWindow::on_refreshPortListButton_clicked()
 {
 	ui->portList->clear();
-	for(auto const & port : QSerialPortInfo::availablePorts())
+	for(auto const & info : QSerialPortInfo::availablePorts())
 	{
-		ui->portList->addItem(port.description() + " (" + port.portName() + ")", port.portName());
+		ui->portList->addItem(info.description() + " (" + info.portName() + ")", info.portName());
 	}
+	ui->portList->addItem("Loopback", "loopback");
 	updateUI();
 }
 
@@ -553,6 +587,11 @@ struct ReadCommand : MainWindow::Command
 		assert(length % 4 == 0);
 	}
 
+	QString phase() const override
+	{
+		return "isp-read";
+	}
+
 	void onInit() override
 	{
 		write(QString("R %0 %1\r\n").arg(start_offset).arg(remaining).toUtf8());
@@ -576,7 +615,7 @@ struct ReadCommand : MainWindow::Command
 				if(status != 0)
 				{
 					qDebug() << "Failed to read data:" << status;
-					return done();
+					return done(false);
 				}
 
 				qDebug() << "Got OK.";
@@ -591,6 +630,7 @@ struct ReadCommand : MainWindow::Command
 				int len = UU::decode_into(buffer, line.trimmed());
 				assert(len <= remaining);
 				remaining -= len;
+				owner->report.addBytes(len);
 				line_counter++;
 				if(line_counter >= 20 or remaining == 0)
 				{
@@ -614,6 +654,7 @@ struct ReadCommand : MainWindow::Command
 				if(cs_syn != cs)
 				{
 					qDebug() << "Invalid checksum! Received " << cs_syn << "but i have" << cs;
+					owner->report.addRetry();
 					remaining += (buffer.size() - checksum_offset);
 					buffer.resize(checksum_offset);
 					state = ReadData;
@@ -666,6 +707,11 @@ struct WriteCommand : MainWindow::Command
 		assert(data.size() % 4 == 0);
 	}
 
+	QString phase() const override
+	{
+		return "upload";
+	}
+
 	void onInit() override
 	{
 		port().clear();
@@ -695,6 +741,7 @@ struct WriteCommand : MainWindow::Command
 			write(encoded);
 			write("\r\n");
 			transferred += len;
+			owner->report.addBytes(len);
 		}
 		write(QString::number(calculated_checksum).toUtf8());
 		write("\r\n");
@@ -718,7 +765,7 @@ struct WriteCommand : MainWindow::Command
 				if(status != 0)
 				{
 					qDebug() << "Failed to read data:" << status;
-					return done();
+					return done(false);
 				}
 
 				qDebug() << "Got OK.";
@@ -737,6 +784,7 @@ struct WriteCommand : MainWindow::Command
 				}
 				else if(line == "RESEND\r\n")
 				{
+					owner->report.addRetry();
 					transferred = transferred_backup;
 					return writeNextBlock();
 				}
@@ -767,7 +815,7 @@ struct SimpleCommand : MainWindow::Command
 		if(status != 0)
 		{
 			qDebug() << "Failed to read data:" << status;
-			return done();
+			return done(false);
 		}
 
 		qDebug() << "Got OK.";
@@ -792,6 +840,11 @@ struct SimpleCommand : MainWindow::Command
 
 struct UnlockCommand : SimpleCommand
 {
+	QString phase() const override
+	{
+		return "unlock";
+	}
+
 	void onInit() override
 	{
 		port().clear();
@@ -799,18 +852,86 @@ struct UnlockCommand : SimpleCommand
 	}
 };
 
+//! Reads part ID and serial number through the ISP. They identify the
+//! device in the flash journal, a device that can't be identified is
+//! programmed without journal.
+struct IdentifyCommand : SimpleCommand
+{
+	enum State { WaitForPartIdOK, WaitForPartId, WaitForSerialOK, WaitForSerial };
+	State state;
+	QStringList words;
+
+	QString phase() const override
+	{
+		return "identify";
+	}
+
+	void onInit() override
+	{
+		port().clear();
+		write("J\r\n");
+		state = WaitForPartIdOK;
+	}
+
+	void processLine(QByteArray const & line) override
+	{
+		bool ok;
+		uint32_t const value = line.trimmed().toUInt(&ok);
+		if(not ok or ((state == WaitForPartIdOK or state == WaitForSerialOK) and value != 0))
+		{
+			qDebug() << "Failed to identify device:" << line;
+			owner->logLine(QString("device can't be identified, programming is not journaled"));
+			return done();
+		}
+
+		switch(state)
+		{
+			case WaitForPartIdOK:
+				state = WaitForPartId;
+				break;
+
+			case WaitForPartId:
+				words << QString("%0").arg(value, 8, 16, QChar('0'));
+				write("N\r\n");
+				state = WaitForSerialOK;
+				break;
+
+			case WaitForSerialOK:
+				state = WaitForSerial;
+				break;
+
+			case WaitForSerial:
+				words << QString("%0").arg(value, 8, 16, QChar('0'));
+				if(words.size() == 5) {
+					owner->deviceIdentity = words.join("-");
+					owner->logLine("device: " + owner->deviceIdentity);
+					return done();
+				}
+				break;
+		}
+	}
+};
+
 struct RunCommand : SimpleCommand
 {
 	enum State { WaitForOK, WaitForBlaster };
 	uint32_t start_address;
+	QByteArray banner;
 	State state;
 
-	explicit RunCommand(uint32_t startAddress) :
-	  start_address(startAddress)
+	//! Starts the code at `startAddress` and waits until it sends `banner`.
+	explicit RunCommand(uint32_t startAddress, QByteArray const & banner = "LPCBlaster ready.\r\n") :
+	  start_address(startAddress),
+	  banner(banner)
 	{
 		assert(start_address % 4 == 0);
 	}
 
+	QString phase() const override
+	{
+		return "run";
+	}
+
 	void onInit() override
 	{
 		port().clear();
@@ -831,7 +952,7 @@ struct RunCommand : SimpleCommand
 				if(status != 0)
 				{
 					qDebug() << "Failed to read data:" << status;
-					return done();
+					return done(false);
 				}
 
 				qDebug() << "Got OK.";
@@ -841,11 +962,12 @@ struct RunCommand : SimpleCommand
 
 			case WaitForBlaster:
 			{
-				if(line == "LPCBlaster ready.\r\n")
+				if(line == banner)
 				{
 					done();
 					assert(owner);
-					owner->state = MainWindow::LPCBlasterReady;
+					if(banner == "LPCBlaster ready.\r\n")
+						owner->state = MainWindow::LPCBlasterReady;
 					port().setFlowControl(QSerialPort::NoFlowControl);
 					return; // everything OK
 				}
@@ -857,6 +979,12 @@ struct RunCommand : SimpleCommand
 
 static uint32_t baseAddress = 0x10001000;
 
+// see BlasterStage0/linker.ld
+static uint32_t stage0Address = 0x10000200;
+
+// baud rate used by the stage 0 loader and the LPCBlaster
+static qint32 blasterBaudRate = 230400;
+
 void MainWindow::on_readBlockButton_clicked()
 {
 	run<ReadCommand>(baseAddress, 512);
@@ -889,31 +1017,59 @@ void MainWindow::on_startBlasterButton_clicked()
 
 	QByteArray firmware = std::get<0>(*bootloader);
 
+	// Upload the small stage 0 loader through the ISP and let it receive
+	// the firmware in binary. Fall back to uploading the whole firmware
+	// through the ISP if the loader is not available.
+	auto const stage0 = ELFLoader::load_binary("BlasterStage0.bin", stage0Address);
+	if(stage0)
+	{
+		QByteArray loader = std::get<0>(*stage0);
+		loader.resize(4 * ((loader.size() + 3) / 4));
+
+		run<IdentifyCommand>()
+			.continueWith<WriteCommand>(stage0Address, loader)
+			.continueWith<UnlockCommand>()
+			.continueWith<RunCommand>(std::get<1>(*stage0) & ~1U, "LPCBlaster stage 0 ready.\r\n") // Stage0Entry
+			.continueWith<Stage0Command>(firmware, baseAddress, std::get<1>(*bootloader), std::get<2>(*bootloader), port->baudRate(),
+				port->canChangeBaudRate() ? blasterBaudRate : port->baudRate())
+			.continueWith<Blaster::VersionCommand>()
+		;
+		return;
+	}
+
 	firmware.resize(256 * ((firmware.size() + 255) / 256));
 
-	run<WriteCommand>(baseAddress + 0x000, firmware)
+	run<IdentifyCommand>()
+		.continueWith<WriteCommand>(baseAddress + 0x000, firmware)
 		.continueWith<UnlockCommand>()
 		.continueWith<RunCommand>(std::get<1>(*bootloader) & ~1U) // LPCBlasterEntry
+		.continueWith<Blaster::VersionCommand>()
 	;
 }
 
 void MainWindow::run(std::unique_ptr<Command> && command)
 {
-	assert(state == ConnectionEstablished);
+	assert(state == ConnectionEstablished or state == LPCBlasterReady);
+	idleState = state;
 	this->currentCommand = std::move(command);
 	this->currentCommand->owner = this;
 	state = CommandStarted;
+	if(auto const name = this->currentCommand->phase(); not name.isEmpty())
+		report.beginPhase(name);
 	this->currentCommand->onInit();
 }
 
-void MainWindow::Command::done()
+void MainWindow::Command::done(bool success)
 {
 	assert(owner);
 	assert(owner->state == CommandStarted);
-	owner->state = ConnectionEstablished;
+	owner->state = owner->idleState;
 	isDone = true;
 
-	if(this->continuation)
+	if(not phase().isEmpty())
+		owner->report.endPhase(success);
+
+	if(success and this->continuation)
 	{
 		auto * win = owner;
 		QTimer::singleShot(0, [win]() {
@@ -928,7 +1084,9 @@ void MainWindow::Command::done()
 
 void MainWindow::Command::write(const QByteArray & data)
 {
-	qDebug() << "→ " << data;
+	// blaster packets can be as large as the work buffer, only log the
+	// command byte and the size
+	qDebug() << "→ " << data.left(1) << data.size() << "bytes";
 	port().write(data);
 }
 
@@ -953,53 +1111,433 @@ void MainWindow::on_blastReadBackButton_clicked()
 	uint32_t length = ui->blastReadbackMemoryLen->text().toInt(&ok, 16);
 	if(not ok)
 		return;
-	port.write("R");
-	port.write(reinterpret_cast<char const *>(&offset), 4);
-	port.write(reinterpret_cast<char const *>(&length), 4);
-	state = LPCBlasterTransfer;
-	readback = ReadbackData { offset, length, QByteArray {}, std::make_unique<QProgressBar>() };
-
-	ui->statusBar->addPermanentWidget(readback->progress.get());
 
+	run<ReadbackCommand>(offset, length, has_feature(blasterFeatures, Feature::CompressedReadback));
 	updateUI();
 }
 
 void MainWindow::on_blastZeroMemoryButton_clicked()
 {
 	bool ok;
-	uint16_t offset = ui->blastZeroMemoryStart->text().toInt(&ok, 16);
+	uint32_t offset = ui->blastZeroMemoryStart->text().toUInt(&ok, 16);
 	if(not ok)
 		return;
-	uint16_t length = ui->blastZeroMemoryLen->text().toInt(&ok, 16);
+	uint32_t length = ui->blastZeroMemoryLen->text().toUInt(&ok, 16);
 	if(not ok)
 		return;
-	port.write("Z");
-	port.write(reinterpret_cast<char const *>(&offset), 2);
-	port.write(reinterpret_cast<char const *>(&length), 2);
-	state = LPCBlasterTransfer;
+	bool const wide = has_feature(blasterFeatures, Feature::WideCommands);
+	if(not wide and (offset > 0xFFFF or length > 0xFFFF)) {
+		logLine(QString("offset and length are limited to 16 bit by this blaster"));
+		return;
+	}
+	Blaster::Request zero;
+	zero.packet = Blaster::zero_memory(wide, offset, length);
+	zero.phase = "zero";
+	auto command = std::make_unique<Blaster::SequenceCommand>();
+	command->enqueue(std::move(zero));
+	run(std::move(command));
 	updateUI();
 }
 
 void MainWindow::on_blastLoadMemoryButton_clicked()
 {
 	bool ok;
-	uint16_t offset = ui->blastZeroMemoryStart->text().toInt(&ok, 16);
+	uint32_t offset = ui->blastLoadMemoryStart->text().toUInt(&ok, 16);
 	if(not ok)
 		return;
-	uint16_t length = ui->blastZeroMemoryLen->text().toInt(&ok, 16);
+	uint32_t length = ui->blastLoadMemoryLen->text().toUInt(&ok, 16);
 	if(not ok)
 		return;
-	port.write("L");
-	port.write(reinterpret_cast<char const *>(&offset), 2);
-	port.write(reinterpret_cast<char const *>(&length), 2);
+	bool const wide = has_feature(blasterFeatures, Feature::WideCommands);
+	if(not wide and (offset > 0xFFFF or length > 0xFFFF)) {
+		logLine(QString("offset and length are limited to 16 bit by this blaster"));
+		return;
+	}
+
+	QByteArray payload(int(length), char(ui->blastLoadMemoryValue->value()));
+
+	// sent in packets of the size the link allows
+	auto load = Blaster::load_request(offset, payload);
+	load.phase = "load";
+	auto command = std::make_unique<Blaster::SequenceCommand>();
+	command->enqueue(std::move(load));
+	run(std::move(command));
+	updateUI();
+}
+
+void MainWindow::on_programBrowseButton_clicked()
+{
+	// raw binaries need an address, see ImageSet
+	auto const fileNames = QFileDialog::getOpenFileNames(this, "Select images", QString(), "ELF files (*.elf *.bin);;All files (*)");
+	if(not fileNames.isEmpty())
+		ui->programFileName->setText(fileNames.join(";"));
+}
+
+void MainWindow::on_programButton_clicked()
+{
+	auto const images = ImageSet::load(ui->programFileName->text());
+	if(not images.error.isEmpty()) {
+		logLine(images.error);
+		return;
+	}
+	for(auto const & part : images.parts)
+		logLine(QString("programming %0 bytes at 0x%1 from %2").arg(part.data.size()).arg(part.start, 8, 16, QChar('0')).arg(part.fileName));
+
+	QByteArray const data = images.merged();
+	uint32_t const start_address = images.start();
+	auto sectors = images.sectors(flashLayout);
+
+	// erasing a sector that holds flash between or around the images
+	// would lose it
+	if(images.parts.size() > 1 and not PatchCommand::isSupported(blasterFeatures))
+	{
+		if(auto const partial = images.partialSectors(flashLayout); not partial.empty()) {
+			logLine(QString("cannot program images: sector %0 also holds flash outside the images and the blaster can't patch it").arg(partial.front()));
+			return;
+		}
+	}
+
+	bool const resuming = journal.begin(deviceIdentity, data, start_address, flashLayout);
+	if(resuming and images.parts.size() > 1)
+	{
+		// the sectors in front of the first one the journal has not
+		// verified are done
+		uint32_t const from = journal.resumeAddress();
+		logLine(QString("resuming at 0x%0").arg(from, 8, 16, QChar('0')));
+		sectors.erase(std::remove_if(sectors.begin(), sectors.end(), [&](size_t s) {
+			return flashLayout[s].end_address() <= from;
+		}), sectors.end());
+		if(sectors.empty()) {
+			logLine(QString("images are already programmed"));
+			journal.finish();
+			return;
+		}
+	}
+	else if(resuming)
+	{
+		resumeImage(data, start_address);
+		updateUI();
+		return;
+	}
+
+	if(not deviceIdentity.isEmpty() and has_feature(blasterFeatures, Feature::SectorHashes))
+	{
+		programDelta(images, sectors);
+		updateUI();
+		return;
+	}
+
+	// the sectors between the images are left untouched
+	if(images.parts.size() > 1)
+	{
+		if(sectors.empty()) {
+			logLine(QString("cannot program images: they are not inside the flash"));
+			return;
+		}
+		journal.markUntouched(sectors);
+		Command * last = nullptr;
+		run(programParts(images, sectors, last, true));
+		updateUI();
+		return;
+	}
+
+	programImage(data, start_address, start_address);
+	updateUI();
+}
+
+void MainWindow::resumeImage(const QByteArray & data, uint32_t start_address)
+{
+	// An earlier run of this image was interrupted. Sectors that were
+	// written are read back first, the programming continues with the first
+	// sector that does not match.
+	auto const [ from, to ] = journal.unverifiedRange();
+	if(from == to)
+		return programImage(data, start_address, from);
+
+	logLine(QString("resuming, verifying 0x%0 … 0x%1").arg(from, 8, 16, QChar('0')).arg(to - 1, 8, 16, QChar('0')));
+	auto & readback = run<ReadbackCommand>(from, to - from, has_feature(blasterFeatures, Feature::CompressedReadback));
+	readback.consumer = [this, data = data, start = start_address, from = from](QByteArray const & flash) {
+		journal.verify(data, from, flash);
+		programImage(data, start, journal.resumeAddress());
+	};
+	updateUI();
+}
+
+void MainWindow::programDelta(const ImageSet & images, const std::vector<size_t> & sectors)
+{
+	if(sectors.empty()) {
+		logLine(QString("cannot program image: it is not inside the flash"));
+		return;
+	}
+	auto const expected = SectorCache::expected(images.merged(), images.start(), flashLayout, sectors);
+
+	if(auto const cached = sectorCache.lookup(deviceIdentity, sectors))
+	{
+		logLine(QString("planning with the cached sector hashes"));
+		programSectors(images, sectors, expected, *cached, true);
+		return;
+	}
+
+	logLine(QString("reading sector hashes"));
+	auto & hashes = run<HashCommand>(sectors.front(), sectors.back() - sectors.front() + 1);
+	hashes.consumer = [this, images, sectors, expected](std::vector<uint32_t> const & range) {
+		programSectors(images, sectors, expected, pick(range, sectors), false);
+	};
+}
+
+std::vector<uint32_t> MainWindow::pick(const std::vector<uint32_t> & range, const std::vector<size_t> & sectors)
+{
+	std::vector<uint32_t> hashes;
+	for(size_t sector : sectors)
+		hashes.push_back(range[sector - sectors.front()]);
+	return hashes;
+}
+
+void MainWindow::programSectors(const ImageSet & images, const std::vector<size_t> & sectors, const std::vector<uint32_t> & expected, const std::vector<uint32_t> & current, bool cached)
+{
+	std::vector<size_t> differing;
+	for(size_t i = 0; i < sectors.size(); i++)
+	{
+		if(current[i] != expected[i])
+			differing.push_back(sectors[i]);
+	}
+	logLine(QString("%0 of %1 sectors differ").arg(differing.size()).arg(sectors.size()));
+
+	// the sectors are unknown until the device confirms them
+	sectorCache.forget(deviceIdentity, differing);
+
+	journal.markUntouched(differing);
+	Command * last = nullptr;
+	auto chain = programParts(images, differing, last, false);
+
+	auto confirm = std::make_unique<HashCommand>(sectors.front(), sectors.back() - sectors.front() + 1);
+	confirm->consumer = [this, images, sectors, expected, cached](std::vector<uint32_t> const & range) {
+		auto const hashes = pick(range, sectors);
+		sectorCache.store(deviceIdentity, sectors, hashes);
+		if(hashes == expected) {
+			journal.finish();
+			logLine(QString("sector hashes: good"));
+			return;
+		}
+		if(cached) {
+			// the flash was changed since the cache was written
+			logLine(QString("device differs from the cached sector hashes"));
+			programSectors(images, sectors, expected, hashes, false);
+			return;
+		}
+		logLine(QString("sector hashes: bad"));
+	};
+	if(last)
+		last->continueWith(std::move(confirm));
+	else
+		chain = std::move(confirm);
+
+	// programSectors() is called by the hash command when not using the cache
+	if(state == CommandStarted)
+		currentCommand->continueWith(std::move(chain));
+	else
+		run(std::move(chain));
+}
+
+void MainWindow::programImage(const QByteArray & image, uint32_t start, uint32_t from)
+{
+	uint32_t const end = start + uint32_t(image.size());
+	if(from >= end) {
+		logLine(QString("image is already programmed"));
+		journal.finish();
+		return;
+	}
+	if(from != start)
+		logLine(QString("resuming at 0x%0").arg(from, 8, 16, QChar('0')));
+
+	auto command = std::make_unique<FlashCommand>(
+		from,
+		image.mid(int(from - start)),
+		flashLayout,
+		blasterFeatures,
+		blasterWorkSize
+	);
+	if(journal.isActive())
+		command->journal = &journal;
+
+	// programImage() is called by the readback when resuming
+	if(state == CommandStarted)
+		currentCommand->continueWith(std::move(command));
+	else
+		run(std::move(command));
+}
 
-	QByteArray payload(length, ui->blastLoadMemoryValue->value());
-	port.write(payload);
+void MainWindow::on_verifyButton_clicked()
+{
+	auto const images = ImageSet::load(ui->programFileName->text());
+	if(not images.error.isEmpty()) {
+		logLine(images.error);
+		return;
+	}
 
-	uint16_t cs = 0;
-	for(uint8_t v : payload) cs += v;
-	port.write(reinterpret_cast<char const *>(&cs), 2);
+	QByteArray const data = images.merged();
+	logLine(QString("verifying %0 bytes at 0x%1").arg(data.size()).arg(images.start(), 8, 16, QChar('0')));
+
+	auto & readback = run<ReadbackCommand>(
+		images.start(),
+		uint32_t(data.size()),
+		has_feature(blasterFeatures, Feature::CompressedReadback)
+	);
+	readback.consumer = [this, images, data](QByteArray const & flash) {
+		// only the images are compared, not the flash between them
+		QByteArray image = data;
+		images.fillGaps(image, flash);
+		showDifferences(image, images.start(), flash);
+	};
+	updateUI();
+}
+
+void MainWindow::showDifferences(const QByteArray & image, uint32_t start, const QByteArray & flash)
+{
+	auto const & layout = flashLayout;
+	auto const pages = ImageDiff::differingPages(image, flash);
 
-	state = LPCBlasterTransfer;
+	differingSectors.clear();
+	for(uint32_t page : pages)
+	{
+		uint32_t const first = start + page * 256;
+		uint32_t const last = std::min(first + 255, start + uint32_t(image.size()) - 1);
+		logLine(QString("differs: 0x%0 … 0x%1").arg(first, 8, 16, QChar('0')).arg(last, 8, 16, QChar('0')));
+
+		for(uint32_t address : { first, last })
+		{
+			auto const sector = layout.sectorOf(address);
+			if(sector and std::find(differingSectors.begin(), differingSectors.end(), *sector) == differingSectors.end())
+				differingSectors.push_back(*sector);
+		}
+	}
+	std::sort(differingSectors.begin(), differingSectors.end());
+
+	if(pages.empty()) {
+		logLine(QString("verify: good"));
+	} else {
+		QStringList sectors;
+		for(size_t sector : differingSectors)
+			sectors << QString::number(sector);
+		logLine(QString("verify: %0 pages differ in sectors %1").arg(pages.size()).arg(sectors.join(", ")));
+	}
+
+	verifyImage = image;
+	verifyStart = start;
+	differingPages = pages;
+	ui->reflashButton->setEnabled(not differingSectors.empty());
+}
+
+void MainWindow::on_reflashButton_clicked()
+{
+	if(differingSectors.empty())
+		return;
+
+	// copy the sectors on the device and only send the differing pages
+	if(PatchCommand::isSupported(blasterFeatures))
+	{
+		run<PatchCommand>(verifyStart, verifyImage, differingPages, flashLayout, blasterFeatures, blasterWorkSize);
+		differingSectors.clear();
+		differingPages.clear();
+		ui->reflashButton->setEnabled(false);
+		updateUI();
+		return;
+	}
+
+	FlashCommand * last = nullptr;
+	auto first = flashSectors(verifyImage, verifyStart, differingSectors, last);
+
+	differingSectors.clear();
+	differingPages.clear();
+	ui->reflashButton->setEnabled(false);
+	run(std::move(first));
 	updateUI();
 }
+
+std::unique_ptr<MainWindow::Command> MainWindow::programParts(const ImageSet & images, const std::vector<size_t> & sectors, Command * & last, bool finishesJournal)
+{
+	QByteArray const image = images.merged();
+	uint32_t const start = images.start();
+
+	std::vector<size_t> partial;
+	if(PatchCommand::isSupported(blasterFeatures))
+	{
+		auto const shared = images.partialSectors(flashLayout);
+		std::set_intersection(sectors.begin(), sectors.end(), shared.begin(), shared.end(), std::back_inserter(partial));
+	}
+	std::vector<size_t> whole;
+	std::set_difference(sectors.begin(), sectors.end(), partial.begin(), partial.end(), std::back_inserter(whole));
+
+	FlashCommand * flash = nullptr;
+	auto chain = flashSectors(image, start, whole, flash, &journal);
+	if(flash)
+		flash->finishesJournal = finishesJournal;
+	else if(finishesJournal)
+		journal.finish();
+	last = flash;
+
+	if(partial.empty())
+		return chain;
+
+	// only the bytes of the images are loaded over the copy of the sectors
+	std::vector<PatchCommand::Range> ranges;
+	for(auto const & part : images.parts)
+	{
+		for(size_t s : partial)
+		{
+			uint32_t const from = std::max(part.start, flashLayout[s].start_address);
+			uint32_t const to = std::min(part.end(), flashLayout[s].end_address());
+			if(from < to)
+				ranges.push_back(PatchCommand::Range { from, to });
+		}
+	}
+	logLine(QString("patching %0 sectors that also hold flash outside the images").arg(partial.size()));
+
+	auto patch = std::make_unique<PatchCommand>(start, image, ranges, flashLayout, blasterFeatures, blasterWorkSize);
+	Command * const next = patch.get();
+	if(last)
+		last->continueWith(std::move(patch));
+	else
+		chain = std::move(patch);
+	last = next;
+	return chain;
+}
+
+std::unique_ptr<MainWindow::Command> MainWindow::flashSectors(const QByteArray & image, uint32_t start, const std::vector<size_t> & sectors, FlashCommand * & last, FlashJournal * journal)
+{
+	auto const & layout = flashLayout;
+	uint32_t const end = start + uint32_t(image.size());
+
+	// one flash command for each run of adjacent sectors
+	std::unique_ptr<Command> first;
+	for(size_t i = 0; i < sectors.size(); )
+	{
+		size_t j = i;
+		while(j + 1 < sectors.size() and sectors[j + 1] == sectors[j] + 1)
+			j += 1;
+
+		uint32_t const from = std::max(layout[sectors[i]].start_address, start);
+		uint32_t const to = std::min(layout[sectors[j]].end_address(), end);
+		logLine(QString("flashing sectors %0 … %1").arg(sectors[i]).arg(sectors[j]));
+
+		auto command = std::make_unique<FlashCommand>(
+			from,
+			image.mid(int(from - start), int(to - from)),
+			layout,
+			blasterFeatures,
+			blasterWorkSize
+		);
+		if(journal and journal->isActive())
+			command->journal = journal;
+		command->finishesJournal = false;
+		FlashCommand * const next = command.get();
+		if(last)
+			last->continueWith(std::move(command));
+		else
+			first = std::move(command);
+		last = next;
+
+		i = j + 1;
+	}
+	return first;
+}
@@ -2,16 +2,28 @@
 #define MAINWINDOW_HPP
 
 #include <QMainWindow>
-#include <QSerialPort>
 #include <QLabel>
 #include <functional>
 #include <memory>
-#include <QProgressBar>
+#include <QTimer>
+#include <QElapsedTimer>
+
+#include "commandtimeouts.hpp"
+#include "flashjournal.hpp"
+#include "packetsizer.hpp"
+#include "sectorcache.hpp"
+#include "sectorlayout.hpp"
+#include "sessionreport.hpp"
+#include "syncsettings.hpp"
+#include "transport.hpp"
 
 namespace Ui {
 	class MainWindow;
 }
 
+struct FlashCommand;
+class ImageSet;
+
 class MainWindow : public QMainWindow
 {
 	Q_OBJECT
@@ -28,11 +40,15 @@ public:
 		virtual void onInit() = 0;
 		virtual bool onData() = 0;
 
-		void done();
+		//! Name of the session report phase this command is accounted to.
+		virtual QString phase() const { return QString(); }
+
+		//! Finishes the command. The continuation is only run on success.
+		void done(bool success = true);
 
-		QSerialPort & port() {
-			assert(owner);
-			return owner->port;
+		Transport & port() {
+			assert(owner and owner->port);
+			return *owner->port;
 		}
 
 		void continueWith(std::unique_ptr<Command> && cmd) {
@@ -55,6 +71,8 @@ public:
 
 	enum State {
 		PortOpen,
+		ResettingTarget,
+		WaitForProbe,
 		WaitForInitialSynchronized,
 		WaitForInitialOK,
 		WaitForFrequencyOK,
@@ -62,26 +80,42 @@ public:
 		ConnectionEstablished,
 		CommandStarted,
 		LPCBlasterReady,
-		LPCBlasterTransfer,
-		LPCBlasterError,
-		LPCBlasterReadbackData,
-		LPCBlasterReadbackChecksum,
 	};
 
-	QSerialPort port;
+	std::unique_ptr<Transport> port; // null until opened once
 	State state;
+	State idleState = ConnectionEstablished;
 	QLabel * stateLabel;
 	std::unique_ptr<Command> currentCommand;
+	SessionReport report;
+
+	SyncSettings syncSettings;
+	CommandTimeouts timeouts;
+	PacketSizer packetSizer;
+	QTimer syncTimer;
+	std::function<void()> syncAction;
+	int syncAttempt = 0;
+	QElapsedTimer connectTimer;
+
+	// capabilities of the running blaster, see BlasterFirmware/protocol.hpp
+	uint8_t blasterProtocol = 1;
+	uint32_t blasterFeatures = 0;
+	uint32_t blasterWorkSize = 32768;
+	uint32_t partId = 0;
+	SectorLayout flashLayout = SectorLayout::lpc17xx();
+
+	// part ID and serial number read through the ISP or reported by I,
+	// empty if unknown
+	QString deviceIdentity;
+	FlashJournal journal;
+	SectorCache sectorCache;
+
+	// result of the last verify, see on_reflashButton_clicked()
+	QByteArray verifyImage;
+	uint32_t verifyStart = 0;
+	std::vector<size_t> differingSectors;
+	std::vector<uint32_t> differingPages;
 
-	struct ReadbackData
-	{
-		uint32_t offset;
-		uint32_t length;
-		QByteArray buffer;
-		std::unique_ptr<QProgressBar> progress;
-	};
-
-	std::optional<ReadbackData> readback;
 
 public:
 	explicit MainWindow(QWidget *parent = nullptr);
@@ -114,12 +148,71 @@ private:
 
 	bool connectToISP();
 
+	//! Runs `action` after `ms` milliseconds unless the sync sequence is
+	//! rescheduled or stopped before.
+	void scheduleSync(int ms, std::function<void()> && action);
+
+	void resetIntoISP(int attempt);
+
+	//! (Re)starts the timeout for the next answer of the handshake.
+	void armSyncTimeout();
+
+	void retrySync();
+
+	void syncFinished();
+
+	void finishSession();
+
 	void on_port_ready();
 
 	bool process_port_data();
 
 	void updateUI();
 
+	//! Transport address of the selected or typed port, see Transport::create().
+	QString portAddress() const;
+
+	//! Programs `image` from `from` on, which is `start` or the start of
+	//! a sector inside the image when resuming.
+	void programImage(QByteArray const & image, uint32_t start, uint32_t from);
+
+	//! Continues the interrupted programming of `image` recorded in the
+	//! journal. Written sectors are read back before programming resumes.
+	void resumeImage(QByteArray const & image, uint32_t start);
+
+	//! Programs only those of `sectors` whose CRC-32 differs from the image.
+	//! The hashes of the device are taken from the sector cache if it knows
+	//! them, otherwise they are read with H.
+	void programDelta(ImageSet const & images, std::vector<size_t> const & sectors);
+
+	//! Programs the sectors where `current` differs from `expected` and
+	//! confirms the result with H. If `current` came from the cache and the
+	//! device does not match it, the remaining differences are programmed.
+	void programSectors(ImageSet const & images, std::vector<size_t> const & sectors,
+		std::vector<uint32_t> const & expected, std::vector<uint32_t> const & current, bool cached);
+
+	//! Picks the hashes of `sectors` from the hashes of the range
+	//! [sectors.front(), sectors.back()] read with H.
+	static std::vector<uint32_t> pick(std::vector<uint32_t> const & range, std::vector<size_t> const & sectors);
+
+	//! Chains the commands that program `sectors` of `images` and stores the
+	//! last one in `last`. Sectors that also hold flash outside the images
+	//! are patched if the blaster supports it, so that flash is kept, the
+	//! others are flashed with flashSectors(). The patches are not recorded
+	//! in the journal. If `finishesJournal` is set, the record is removed
+	//! after the last flash command.
+	std::unique_ptr<Command> programParts(ImageSet const & images, std::vector<size_t> const & sectors,
+		Command * & last, bool finishesJournal);
+
+	//! Chains a FlashCommand for each run of adjacent `sectors` and stores
+	//! the last one in `last`. The commands record into `journal` if it is
+	//! active, none of them finishes the record.
+	std::unique_ptr<Command> flashSectors(QByteArray const & image, uint32_t start, std::vector<size_t> const & sectors,
+		FlashCommand * & last, FlashJournal * journal = nullptr);
+
+	//! Compares the flash content with the image and logs the differences.
+	void showDifferences(QByteArray const & image, uint32_t start, QByteArray const & flash);
+
 private slots:
 	void on_connectButton_clicked();
 
@@ -149,6 +242,14 @@ private slots:
 
 	void on_blastLoadMemoryButton_clicked();
 
+	void on_programBrowseButton_clicked();
+
+	void on_programButton_clicked();
+
+	void on_verifyButton_clicked();
+
+	void on_reflashButton_clicked();
+
 private:
 	Ui::MainWindow *ui;
 };
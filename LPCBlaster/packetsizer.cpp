@@ -0,0 +1,129 @@
+#include "packetsizer.hpp"
+
+#include <QDebug>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QSettings>
+#include <algorithm>
+
+static QJsonObject read_links(QString const & fileName)
+{
+	QFile file(fileName);
+	if(not file.open(QFile::ReadOnly))
+		return QJsonObject();
+	return QJsonDocument::fromJson(file.readAll()).object();
+}
+
+PacketSizer::PacketSizer(QString fileName) :
+  fileName(std::move(fileName))
+{
+
+}
+
+void PacketSizer::configure(const QString & settingsFile)
+{
+	QSettings settings(settingsFile, QSettings::IniFormat);
+	settings.beginGroup("fec");
+	maximumParity = std::clamp(settings.value("maximumParity", maximumParity).toInt(), 0, int(fec_max_parity));
+	minimumParity = std::clamp(settings.value("minimumParity", minimumParity).toInt(), 0, maximumParity);
+	settings.endGroup();
+	checkBytes = std::clamp(checkBytes, minimumParity, maximumParity);
+}
+
+void PacketSizer::select(const QString & port)
+{
+	this->port = port;
+	auto const link = read_links(fileName).value(port).toObject();
+	current = std::clamp(link.value("packetSize").toInt(maximum_size), minimum_size, maximum_size);
+	ceiling = current;
+	successes = 0;
+	checkBytes = std::clamp(link.value("fecParity").toInt(0), minimumParity, maximumParity);
+	clean = 0;
+	changed = false;
+}
+
+void PacketSizer::setLimit(int bytes)
+{
+	limit = std::clamp(bytes, minimum_size, maximum_size);
+}
+
+void PacketSizer::succeeded(int length)
+{
+	// short loads say nothing about the current size
+	if(length < size())
+		return;
+	successes += 1;
+
+	if(current >= std::min(ceiling, limit)) {
+		if(successes >= probe_after and ceiling < limit) {
+			ceiling = std::min(ceiling * 2, limit);
+			successes = 0;
+		}
+		return;
+	}
+	if(successes >= grow_after) {
+		current = std::min({ current * 2, ceiling, limit });
+		successes = 0;
+		changed = true;
+	}
+}
+
+bool PacketSizer::failed()
+{
+	successes = 0;
+	if(size() <= minimum_size)
+		return false;
+	ceiling = std::max(minimum_size, size() / 2);
+	current = ceiling;
+	changed = true;
+	return true;
+}
+
+bool PacketSizer::strengthen()
+{
+	clean = 0;
+	if(checkBytes >= maximumParity)
+		return false;
+	checkBytes = std::clamp(checkBytes * 2, std::min(initial_parity, maximumParity), maximumParity);
+	changed = true;
+	return true;
+}
+
+bool PacketSizer::decoded(int blocks, int corrected, int lost)
+{
+	if(lost > 0 or 4 * corrected > blocks * checkBytes)
+		return strengthen() or lost == 0;
+	if(corrected > 0) {
+		clean = 0;
+		return true;
+	}
+	clean += 1;
+	if(clean < relax_after or checkBytes <= minimumParity)
+		return true;
+	clean = 0;
+	checkBytes = std::max(checkBytes >= 4 ? checkBytes / 2 : 0, minimumParity);
+	changed = true;
+	return true;
+}
+
+void PacketSizer::save()
+{
+	if(port.isEmpty() or not changed)
+		return;
+	changed = false;
+	auto links = read_links(fileName);
+	auto link = links.value(port).toObject();
+	link["packetSize"] = current;
+	link["fecParity"] = checkBytes;
+	links[port] = link;
+
+	QSaveFile file(fileName);
+	if(not file.open(QFile::WriteOnly)) {
+		qDebug() << "failed to write link settings";
+		return;
+	}
+	file.write(QJsonDocument(links).toJson());
+	file.commit();
+}
@@ -0,0 +1,91 @@
+#ifndef PACKETSIZER_HPP
+#define PACKETSIZER_HPP
+
+#include <QString>
+#include <algorithm>
+
+#include "../BlasterFirmware/protocol.hpp"
+
+//! Chooses the payload size of work buffer loads for the current link.
+//!
+//! The size doubles after a run of full sized loads without errors and
+//! halves on each Invalid Checksum. After a failure it grows up to half
+//! the failed size only, and tries the failed size again after a long run
+//! without errors. It never exceeds the limit the blaster takes. The size
+//! is remembered per port, so a noisy adapter starts with the size that
+//! worked last time.
+//!
+//! It also chooses the Reed-Solomon check bytes per block of D loads. With
+//! a blaster that supports them, the first Invalid Checksum turns them on
+//! instead of shrinking the size. They double when blocks can't be
+//! corrected or a quarter of the check bytes was used, and halve after a
+//! run of loads without corrections, down to plain loads again. Only at the
+//! largest parity does the size shrink.
+class PacketSizer
+{
+	QString fileName;
+	QString port;
+	int current = maximum_size;
+	int ceiling = maximum_size; // largest size to grow to
+	int limit = maximum_size;   // largest size the blaster takes
+	int successes = 0;          // full sized loads since the last change
+	int checkBytes = 0;         // per D block, 0 for plain loads
+	int clean = 0;              // D loads without corrections since the last change
+	int minimumParity = 0;
+	int maximumParity = int(fec_max_parity);
+	bool changed = false;       // not saved to the store yet
+
+public:
+	static constexpr int minimum_size = 64;
+	static constexpr int maximum_size = 1 << 20;
+
+	//! Full sized loads without error before the size doubles.
+	static constexpr int grow_after = 8;
+
+	//! Loads without error before the ceiling is lifted again.
+	static constexpr int probe_after = 64;
+
+	//! Check bytes per block when FEC is turned on.
+	static constexpr int initial_parity = 8;
+
+	//! D loads without corrections before the check bytes halve.
+	static constexpr int relax_after = 16;
+
+	explicit PacketSizer(QString fileName = "LPCBlaster-links.json");
+
+	//! Reads the parity limits from the [fec] group of `settingsFile`.
+	void configure(QString const & settingsFile);
+
+	//! Continues with the size remembered for `port`.
+	void select(QString const & port);
+
+	//! Loads can't be larger than `bytes`, the size of the work buffer.
+	void setLimit(int bytes);
+
+	int size() const { return std::min(current, limit); }
+
+	//! A load of `length` bytes was acknowledged.
+	void succeeded(int length);
+
+	//! A load was answered with Invalid Checksum. Returns false if the
+	//! size can't shrink any further.
+	bool failed();
+
+	//! Check bytes per block of D loads, 0 for plain loads.
+	int parity() const { return checkBytes; }
+
+	//! Turns FEC on or doubles the check bytes. Returns false if they are
+	//! at the maximum already.
+	bool strengthen();
+
+	//! A D load of `blocks` blocks needed `corrected` corrections and
+	//! lost `lost` blocks. Returns false if blocks were lost although the
+	//! check bytes are at the maximum.
+	bool decoded(int blocks, int corrected, int lost);
+
+	//! Writes the size and the check bytes of the port to the store if they
+	//! changed since the last save.
+	void save();
+};
+
+#endif // PACKETSIZER_HPP
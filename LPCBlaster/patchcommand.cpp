@@ -0,0 +1,123 @@
+#include "patchcommand.hpp"
+
+#include <algorithm>
+
+PatchCommand::PatchCommand(uint32_t base_address, const QByteArray & image, const std::vector<uint32_t> & pages, const SectorLayout & layout, uint32_t features, uint32_t work_size) :
+  PatchCommand(base_address, image, pageRanges(base_address, image, pages), layout, features, work_size)
+{
+
+}
+
+PatchCommand::PatchCommand(uint32_t base_address, const QByteArray & image, const std::vector<Range> & ranges, const SectorLayout & layout, uint32_t features, uint32_t work_size) :
+  features(features)
+{
+	if(ranges.empty())
+		return;
+
+	for(uint32_t address : { ranges.front().from, ranges.back().to - 1 })
+	{
+		if(not layout.sectorOf(address)) {
+			error = QString("address 0x%0 is not inside the flash").arg(address, 8, 16, QChar('0'));
+			return;
+		}
+	}
+
+	// collect adjacent sectors as long as they fit into the work buffer
+	size_t first = *layout.sectorOf(ranges.front().from);
+	size_t last = first;
+	std::vector<Range> batch;
+	for(auto range : ranges)
+	{
+		while(range.from < range.to)
+		{
+			size_t const sector = *layout.sectorOf(range.from);
+			uint32_t const to = std::min(range.to, layout[sector].end_address());
+
+			bool const adjacent = (sector <= last + 1);
+			bool const fits = layout[sector].end_address() - layout[first].start_address <= work_size;
+			if(not batch.empty() and not (adjacent and fits))
+			{
+				enqueueBatch(layout, first, last, batch, base_address, image);
+				batch.clear();
+				first = sector;
+			}
+			if(layout[sector].length > work_size) {
+				error = QString("sector %0 does not fit into the work buffer").arg(sector);
+				return;
+			}
+			last = sector;
+
+			batch.push_back(Range { range.from, to });
+			range.from = to;
+		}
+	}
+	enqueueBatch(layout, first, last, batch, base_address, image);
+}
+
+std::vector<PatchCommand::Range> PatchCommand::pageRanges(uint32_t base_address, const QByteArray & image, const std::vector<uint32_t> & pages)
+{
+	std::vector<Range> ranges;
+	for(uint32_t page : pages)
+	{
+		uint32_t const from = base_address + page * 256;
+		uint32_t const to = base_address + std::min<uint32_t>(page * 256 + 256, uint32_t(image.size()));
+		if(not ranges.empty() and ranges.back().to == from)
+			ranges.back().to = to;
+		else
+			ranges.push_back(Range { from, to });
+	}
+	return ranges;
+}
+
+bool PatchCommand::isSupported(uint32_t features)
+{
+	return has_feature(features, Feature::CopyFlash) and has_feature(features, Feature::WideCommands);
+}
+
+void PatchCommand::enqueueBatch(const SectorLayout & layout, size_t first, size_t last, const std::vector<Range> & ranges, uint32_t base_address, const QByteArray & image)
+{
+	uint32_t const start = layout[first].start_address;
+	uint32_t const length = layout[last].end_address() - start;
+
+	Blaster::Request copy;
+	copy.packet = Blaster::copy_flash(start, 0, length);
+	copy.phase = "copy";
+	enqueue(std::move(copy));
+
+	for(auto const & range : ranges)
+	{
+		auto load = Blaster::load_request(range.from - start, image.mid(int(range.from - base_address), int(range.to - range.from)));
+		load.phase = "load";
+		loadedBytes += range.to - range.from;
+		enqueue(std::move(load));
+	}
+
+	Blaster::Request write;
+	write.packet = Blaster::erase_and_write(true, start, 0, length);
+	write.phase = "write";
+	write.bytes = length;
+	write.onReply = [this, first, last](Blaster::Reply const & reply)
+	{
+		if(not reply.ack) {
+			owner->logLine(QString("failed to patch sectors %0 … %1: %2 (%3)")
+				.arg(first)
+				.arg(last)
+				.arg(Blaster::errorName(reply.error))
+				.arg(reply.info));
+			return false;
+		}
+		owner->logLine(QString("patched sectors %0 … %1").arg(first).arg(last));
+		return true;
+	};
+	enqueue(std::move(write));
+}
+
+void PatchCommand::onInit()
+{
+	if(not error.isEmpty()) {
+		owner->logLine("cannot patch image: " + error);
+		return done(false);
+	}
+	owner->logLine(QString("patching with %0 bytes").arg(loadedBytes));
+	SequenceCommand::onInit();
+}
@@ -0,0 +1,60 @@
+#ifndef PATCHCOMMAND_HPP
+#define PATCHCOMMAND_HPP
+
+#include "blaster.hpp"
+#include "sectorlayout.hpp"
+
+//! Writes single pages of an image without sending the whole sectors.
+//!
+//! The sectors that contain the pages are copied to the work buffer with C,
+//! only the pages are loaded over the copy and the sectors are erased and
+//! written with w. Adjacent sectors are patched together as long as they
+//! fit into the work buffer. Needs Feature::CopyFlash and Feature::WideCommands.
+struct PatchCommand : Blaster::SequenceCommand
+{
+	QString error;
+	uint32_t features;
+
+	struct Range
+	{
+		uint32_t from, to;
+	};
+
+	//! `pages` are the indices of the 256 byte pages of `image` that are
+	//! written, as returned by ImageDiff::differingPages().
+	explicit PatchCommand(
+		uint32_t base_address,
+		QByteArray const & image,
+		std::vector<uint32_t> const & pages,
+		SectorLayout const & layout,
+		uint32_t features,
+		uint32_t work_size
+	);
+
+	//! Writes the address `ranges` of `image`, sorted and not overlapping.
+	//! The rest of the touched sectors keeps its content.
+	explicit PatchCommand(
+		uint32_t base_address,
+		QByteArray const & image,
+		std::vector<Range> const & ranges,
+		SectorLayout const & layout,
+		uint32_t features,
+		uint32_t work_size
+	);
+
+	void onInit() override;
+
+	static bool isSupported(uint32_t features);
+
+private:
+	//! The address ranges of `pages`, adjacent pages merged.
+	static std::vector<Range> pageRanges(uint32_t base_address, QByteArray const & image, std::vector<uint32_t> const & pages);
+
+	//! Patches the sectors [first, last] with `ranges` of the image.
+	void enqueueBatch(SectorLayout const & layout, size_t first, size_t last, std::vector<Range> const & ranges,
+		uint32_t base_address, QByteArray const & image);
+
+	uint32_t loadedBytes = 0;
+};
+
+#endif // PATCHCOMMAND_HPP
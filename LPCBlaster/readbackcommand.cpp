@@ -0,0 +1,196 @@
+#include "readbackcommand.hpp"
+
+#include <cstring>
+
+ReadbackCommand::ReadbackCommand(uint32_t offset, uint32_t length, bool compressed) :
+  offset(offset),
+  length(length),
+  compressed(compressed)
+{
+	data = QByteArray(int(length), '\0');
+	attempts.assign(size_t(blockCount()), 1);
+	checks.assign(size_t(blockCount()), BlockCheck { });
+	remaining = blockCount();
+
+	if(compressed) {
+		enqueueBlocks(0, blockCount());
+	} else {
+		for(int i = 0; i < blockCount(); i++)
+			enqueueBlocks(i, 1);
+	}
+}
+
+void ReadbackCommand::onInit()
+{
+	if(length == 0) {
+		owner->logLine(QString("nothing to read"));
+		return done(false);
+	}
+	progress = std::make_unique<QProgressBar>();
+	owner->statusBar()->addPermanentWidget(progress.get());
+	progressTimer.start();
+	SequenceCommand::onInit();
+}
+
+int ReadbackCommand::blockCount() const
+{
+	return int((uint64_t(length) + readback_block_size - 1) / readback_block_size);
+}
+
+int ReadbackCommand::blockLength(int index) const
+{
+	return int(std::min<uint32_t>(readback_block_size, length - uint32_t(index) * readback_block_size));
+}
+
+void ReadbackCommand::enqueueBlocks(int first, int count)
+{
+	uint32_t const start = offset + uint32_t(first) * readback_block_size;
+	uint32_t size = 0;
+	for(int i = first; i < first + count; i++)
+		size += uint32_t(blockLength(i));
+
+	Blaster::Request request;
+	request.phase = "readback";
+	request.bytes = size;
+
+	if(compressed)
+	{
+		request.packet = Blaster::readback_compressed(start, size);
+
+		// Walk the blocks received so far to find the total size, and decode
+		// and sum each one as soon as it is complete. The walk continues
+		// where the last call stopped, as this is called for each chunk of
+		// data that arrives, and starts over when the request is sent again.
+		struct Walk
+		{
+			int blocks = 0;
+			int position = 0;
+		};
+		request.makePayloadSize = [this, first, count]() -> Blaster::PayloadSize
+		{
+			return [this, first, count, walk = Walk { }](QByteArray const & received) mutable
+			{
+				while(walk.blocks < count)
+				{
+					if(walk.position + 2 > received.size())
+						return walk.position + 2;
+					int const encoded_length = Blaster::extract<uint16_t>(received, walk.position);
+					int const end = walk.position + 2 + encoded_length + 2;
+					if(end > received.size())
+						return end;
+
+					int const index = first + walk.blocks;
+					auto & check = checks[size_t(index)];
+					check.valid = Blaster::rle_decode(
+						received.constData() + walk.position + 2,
+						encoded_length,
+						data.data() + index * int(readback_block_size),
+						blockLength(index)
+					);
+					check.local = check.valid ? blockChecksum(index) : 0;
+					check.remote = Blaster::extract<uint16_t>(received, end - 2);
+
+					walk.position = end;
+					walk.blocks += 1;
+					updateProgress(blockCount() - remaining + walk.blocks);
+				}
+				return walk.position;
+			};
+		};
+		request.onReply = [this, first, count](Blaster::Reply const & reply)
+		{
+			if(not reply.ack) {
+				owner->logLine(QString("LPCBlaster returned error: %0 (%1)").arg(Blaster::errorName(reply.error)).arg(reply.info));
+				return false;
+			}
+			bool ok = true;
+			for(int i = first; i < first + count; i++)
+				ok &= blockReceived(i);
+			return ok;
+		};
+	}
+	else
+	{
+		assert(count == 1);
+		int const block_length = blockLength(first);
+		request.packet.append('R');
+		Blaster::append<uint32_t>(request.packet, start);
+		Blaster::append<uint32_t>(request.packet, size);
+		// copy and sum each chunk of the block as it arrives
+		request.makePayloadSize = [this, first, block_length]() -> Blaster::PayloadSize
+		{
+			checks[size_t(first)] = BlockCheck { true, 0, 0 };
+			return [this, first, block_length, summed = 0](QByteArray const & received) mutable
+			{
+				int const end = std::min(received.size(), block_length);
+				auto const * chunk = reinterpret_cast<uint8_t const *>(received.constData());
+				char * const block = data.data() + first * int(readback_block_size);
+				memcpy(block + summed, chunk + summed, size_t(end - summed));
+				auto & check = checks[size_t(first)];
+				for(; summed < end; summed++)
+					check.local += chunk[summed];
+				return block_length + 2;
+			};
+		};
+		request.onReply = [this, first, block_length](Blaster::Reply const & reply)
+		{
+			if(not reply.ack) {
+				owner->logLine(QString("LPCBlaster returned error: %0 (%1)").arg(Blaster::errorName(reply.error)).arg(reply.info));
+				return false;
+			}
+			checks[size_t(first)].remote = Blaster::extract<uint16_t>(reply.payload, block_length);
+			return blockReceived(first);
+		};
+	}
+
+	enqueue(std::move(request));
+}
+
+uint16_t ReadbackCommand::blockChecksum(int index) const
+{
+	auto const * block = reinterpret_cast<uint8_t const *>(data.constData() + index * int(readback_block_size));
+	uint16_t sum = 0;
+	for(int i = 0; i < blockLength(index); i++)
+		sum += block[i];
+	return sum;
+}
+
+bool ReadbackCommand::blockReceived(int index)
+{
+	auto const & check = checks[size_t(index)];
+	if(not check.valid or check.local != check.remote)
+	{
+		if(attempts[size_t(index)] < max_attempts) {
+			qDebug() << "bad checksum in block" << index << ", reading it again";
+			owner->report.addRetry();
+			attempts[size_t(index)] += 1;
+			enqueueBlocks(index, 1);
+			return true;
+		}
+		owner->logLine(QString("checksum: bad in block %0 after %1 attempts").arg(index).arg(max_attempts));
+		blockFailed = true;
+	}
+
+	remaining -= 1;
+	updateProgress(blockCount() - remaining, remaining == 0);
+	if(remaining > 0)
+		return true;
+
+	if(blockFailed)
+		return false;
+	if(consumer) {
+		consumer(data);
+	} else {
+		owner->dumpHex(data, int(offset));
+		owner->logLine(QString("checksum: good"));
+	}
+	return true;
+}
+
+void ReadbackCommand::updateProgress(int blocks_done, bool force)
+{
+	if(not force and progressTimer.elapsed() < progress_interval_ms)
+		return;
+	progressTimer.restart();
+	progress->setValue(int(100LL * std::min(blocks_done, blockCount()) / blockCount()));
+}
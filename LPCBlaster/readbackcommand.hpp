@@ -0,0 +1,73 @@
+#ifndef READBACKCOMMAND_HPP
+#define READBACKCOMMAND_HPP
+
+#include "blaster.hpp"
+
+#include <QElapsedTimer>
+#include <QProgressBar>
+#include <memory>
+
+//! Reads memory in blocks of readback_block_size bytes and dumps it.
+//! Each block has its own checksum, blocks with a bad checksum are
+//! requested again instead of reading everything again.
+//!
+//! With Feature::CompressedReadback all blocks are requested at once with r,
+//! otherwise each block is requested with R.
+//!
+//! Blocks are decoded straight into `data`, which is allocated once, and
+//! their checksums are calculated while the reply arrives: R sums each
+//! chunk as it is received, r each block as soon as it is complete.
+struct ReadbackCommand : Blaster::SequenceCommand
+{
+	static constexpr int max_attempts = 4;
+
+	//! Minimum time between two updates of the progress bar.
+	static constexpr qint64 progress_interval_ms = 50;
+
+	uint32_t offset;
+	uint32_t length;
+	bool compressed;
+
+	QByteArray data;
+	std::vector<int> attempts;
+
+	struct BlockCheck
+	{
+		bool valid = false;   // decoded to the block length
+		uint16_t local = 0;   // sum of the bytes in `data`
+		uint16_t remote = 0;  // sum the blaster sent
+	};
+	std::vector<BlockCheck> checks;
+
+	int remaining;
+	bool blockFailed = false; // a block stayed bad after max_attempts
+	std::unique_ptr<QProgressBar> progress;
+	QElapsedTimer progressTimer;
+
+	//! Receives the memory if all blocks are good. Dumps it if not set.
+	std::function<void(QByteArray const &)> consumer;
+
+	explicit ReadbackCommand(uint32_t offset, uint32_t length, bool compressed);
+
+	void onInit() override;
+
+private:
+	int blockCount() const;
+
+	int blockLength(int index) const;
+
+	//! Requests the blocks [first, first+count).
+	void enqueueBlocks(int first, int count);
+
+	//! Sum of the bytes of block `index` in `data`.
+	uint16_t blockChecksum(int index) const;
+
+	//! Checks a block that was stored in `data` with the sums in `checks`
+	//! or requests it again. Returns false when the last block is done and
+	//! any block failed.
+	bool blockReceived(int index);
+
+	void updateProgress(int blocks_done, bool force = false);
+};
+
+#endif // READBACKCOMMAND_HPP
@@ -0,0 +1,91 @@
+#include "sectorcache.hpp"
+#include "../BlasterFirmware/crc32.hpp"
+
+#include <QDebug>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <algorithm>
+#include <cstring>
+
+static QJsonObject read_cache(QString const & fileName)
+{
+	QFile file(fileName);
+	if(not file.open(QFile::ReadOnly))
+		return QJsonObject();
+	return QJsonDocument::fromJson(file.readAll()).object();
+}
+
+static void write_cache(QString const & fileName, QJsonObject const & cache)
+{
+	QSaveFile file(fileName);
+	if(not file.open(QFile::WriteOnly)) {
+		qDebug() << "failed to write sector cache";
+		return;
+	}
+	file.write(QJsonDocument(cache).toJson());
+	file.commit();
+}
+
+SectorCache::SectorCache(QString fileName) :
+  fileName(std::move(fileName))
+{
+
+}
+
+std::optional<std::vector<uint32_t>> SectorCache::lookup(const QString & device, const std::vector<size_t> & sectors) const
+{
+	auto const entries = read_cache(fileName).value(device).toObject();
+
+	std::vector<uint32_t> hashes;
+	for(size_t sector : sectors)
+	{
+		auto const value = entries.value(QString::number(sector));
+		if(not value.isString())
+			return std::nullopt;
+		bool ok;
+		hashes.push_back(value.toString().toUInt(&ok, 16));
+		if(not ok)
+			return std::nullopt;
+	}
+	return hashes;
+}
+
+void SectorCache::store(const QString & device, const std::vector<size_t> & sectors, const std::vector<uint32_t> & hashes)
+{
+	auto cache = read_cache(fileName);
+	auto entries = cache.value(device).toObject();
+	for(size_t i = 0; i < sectors.size(); i++)
+		entries[QString::number(sectors[i])] = QString("%0").arg(hashes[i], 8, 16, QChar('0'));
+	cache[device] = entries;
+	write_cache(fileName, cache);
+}
+
+void SectorCache::forget(const QString & device, const std::vector<size_t> & sectors)
+{
+	auto cache = read_cache(fileName);
+	auto entries = cache.value(device).toObject();
+	for(size_t sector : sectors)
+		entries.remove(QString::number(sector));
+	cache[device] = entries;
+	write_cache(fileName, cache);
+}
+
+std::vector<uint32_t> SectorCache::expected(const QByteArray & image, uint32_t start, const SectorLayout & layout, const std::vector<size_t> & sectors)
+{
+	uint32_t const end = start + uint32_t(image.size());
+
+	std::vector<uint32_t> hashes;
+	for(size_t index : sectors)
+	{
+		auto const & sector = layout[index];
+		QByteArray content(int(sector.length), char(0xFF));
+		uint32_t const from = std::max(sector.start_address, start);
+		uint32_t const to = std::min(sector.end_address(), end);
+		if(from < to)
+			memcpy(content.data() + (from - sector.start_address), image.constData() + (from - start), to - from);
+		hashes.push_back(crc32::compute_fast(content.constData(), size_t(content.size())));
+	}
+	return hashes;
+}
@@ -0,0 +1,39 @@
+#ifndef SECTORCACHE_HPP
+#define SECTORCACHE_HPP
+
+#include "sectorlayout.hpp"
+
+#include <QByteArray>
+#include <QString>
+#include <optional>
+#include <vector>
+
+//! Remembers the CRC-32 of the sectors that were written to each device,
+//! keyed by the device identity. A new image can then be compared with the
+//! flash content without asking the device.
+//!
+//! Sectors are forgotten before they are written and stored again after
+//! the device confirmed their hashes, so an interrupted write never leaves
+//! a wrong entry behind.
+class SectorCache
+{
+	QString fileName;
+
+public:
+	explicit SectorCache(QString fileName = "LPCBlaster-cache.json");
+
+	//! Hashes of `sectors` of `device`, if all are known.
+	std::optional<std::vector<uint32_t>> lookup(QString const & device, std::vector<size_t> const & sectors) const;
+
+	//! Stores the `hashes` of `sectors`.
+	void store(QString const & device, std::vector<size_t> const & sectors, std::vector<uint32_t> const & hashes);
+
+	void forget(QString const & device, std::vector<size_t> const & sectors);
+
+	//! Hashes of `sectors` after `image` was programmed at `start`. The
+	//! parts of the sectors outside of the image are erased by FlashCommand,
+	//! so they count as 0xFF.
+	static std::vector<uint32_t> expected(QByteArray const & image, uint32_t start, SectorLayout const & layout, std::vector<size_t> const & sectors);
+};
+
+#endif // SECTORCACHE_HPP
@@ -0,0 +1,37 @@
+#include "sectorlayout.hpp"
+
+SectorLayout::SectorLayout(std::vector<Sector> sectors) :
+  sectors(std::move(sectors))
+{
+
+}
+
+SectorLayout SectorLayout::lpc17xx(uint32_t flash_size)
+{
+	std::vector<Sector> list;
+	uint32_t address = 0;
+	while(address < flash_size)
+	{
+		uint32_t const length = (address < 0x10000) ? 4096 : 32768;
+		list.push_back(Sector { address, length });
+		address += length;
+	}
+	return SectorLayout(std::move(list));
+}
+
+uint32_t SectorLayout::flashSize() const
+{
+	if(sectors.empty())
+		return 0;
+	return sectors.back().end_address();
+}
+
+std::optional<size_t> SectorLayout::sectorOf(uint32_t address) const
+{
+	for(size_t i = 0; i < sectors.size(); i++)
+	{
+		if(address >= sectors[i].start_address and address < sectors[i].end_address())
+			return i;
+	}
+	return std::nullopt;
+}
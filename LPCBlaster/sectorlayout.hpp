@@ -0,0 +1,40 @@
+#ifndef SECTORLAYOUT_HPP
+#define SECTORLAYOUT_HPP
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+//! Describes the flash sectors of the target controller.
+class SectorLayout
+{
+public:
+	struct Sector
+	{
+		uint32_t start_address;
+		uint32_t length;
+
+		uint32_t end_address() const { return start_address + length; }
+	};
+
+private:
+	std::vector<Sector> sectors;
+
+public:
+	SectorLayout() = default;
+	explicit SectorLayout(std::vector<Sector> sectors);
+
+	//! Layout of the LPC17xx family: 4 kB sectors for the first 64 kB,
+	//! 32 kB sectors above.
+	static SectorLayout lpc17xx(uint32_t flash_size = 512 * 1024);
+
+	size_t count() const { return sectors.size(); }
+
+	Sector const & operator[](size_t index) const { return sectors[index]; }
+
+	uint32_t flashSize() const;
+
+	std::optional<size_t> sectorOf(uint32_t address) const;
+};
+
+#endif // SECTORLAYOUT_HPP
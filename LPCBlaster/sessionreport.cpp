@@ -0,0 +1,202 @@
+#include "sessionreport.hpp"
+
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QStringList>
+#include <algorithm>
+
+static double to_ms(qint64 ns)
+{
+	return double(ns) / 1e6;
+}
+
+static double throughput(qint64 bytes, qint64 ns)
+{
+	if(ns <= 0)
+		return 0.0;
+	return double(bytes) * 1e9 / double(ns);
+}
+
+void SessionReport::start(const QString & port, qint32 baud)
+{
+	phases.clear();
+	openPhase = -1;
+	portName = port;
+	baudRate = baud;
+	started = QDateTime::currentDateTime();
+	timer.start();
+	active = true;
+}
+
+void SessionReport::finish()
+{
+	endPhase();
+	finishedAfter = elapsed();
+	active = false;
+}
+
+void SessionReport::beginPhase(const QString & name)
+{
+	if(not active)
+		return;
+	endPhase();
+
+	auto const it = std::find_if(phases.begin(), phases.end(), [&](Phase const & p) {
+		return p.name == name;
+	});
+	if(it == phases.end())
+	{
+		Phase phase;
+		phase.name = name;
+		phase.start = elapsed();
+		phases.push_back(phase);
+		openPhase = int(phases.size() - 1);
+	}
+	else
+	{
+		openPhase = int(it - phases.begin());
+	}
+	openSince = elapsed();
+}
+
+void SessionReport::endPhase(bool success)
+{
+	if(not hasOpenPhase())
+		return;
+	auto & phase = phases[openPhase];
+	phase.duration += elapsed() - openSince;
+	phase.success &= success;
+	phase.count += 1;
+	openPhase = -1;
+}
+
+bool SessionReport::hasOpenPhase() const
+{
+	return active and openPhase >= 0;
+}
+
+void SessionReport::addBytes(qint64 count)
+{
+	if(hasOpenPhase())
+		phases[openPhase].bytes += count;
+}
+
+void SessionReport::addRetry()
+{
+	if(hasOpenPhase())
+		phases[openPhase].retries += 1;
+}
+
+qint64 SessionReport::totalBytes() const
+{
+	qint64 sum = 0;
+	for(auto const & phase : phases)
+		sum += phase.bytes;
+	return sum;
+}
+
+int SessionReport::totalRetries() const
+{
+	int sum = 0;
+	for(auto const & phase : phases)
+		sum += phase.retries;
+	return sum;
+}
+
+QJsonObject SessionReport::toJson() const
+{
+	QJsonArray list;
+	bool success = true;
+	qint64 const total = sessionDuration();
+	for(size_t i = 0; i < phases.size(); i++)
+	{
+		auto const & phase = phases[i];
+		bool const finished = (int(i) != openPhase);
+		qint64 const duration = durationOf(i);
+		QJsonObject obj;
+		obj["name"] = phase.name;
+		obj["start_ms"] = to_ms(phase.start);
+		obj["duration_ms"] = to_ms(duration);
+		obj["bytes"] = phase.bytes;
+		obj["retries"] = phase.retries;
+		obj["count"] = phase.count;
+		obj["throughput_bps"] = throughput(phase.bytes, duration);
+		obj["success"] = phase.success and finished;
+		list.append(obj);
+
+		success &= phase.success and finished;
+	}
+
+	QJsonObject report;
+	report["started"] = started.toString(Qt::ISODateWithMs);
+	report["port"] = portName;
+	report["baudrate"] = baudRate;
+	report["total_ms"] = to_ms(total);
+	report["bytes"] = totalBytes();
+	report["retries"] = totalRetries();
+	report["throughput_bps"] = throughput(totalBytes(), total);
+	report["success"] = success;
+	report["phases"] = list;
+	return report;
+}
+
+QString SessionReport::summary() const
+{
+	QStringList parts;
+	bool success = true;
+	qint64 const total = sessionDuration();
+	for(size_t i = 0; i < phases.size(); i++)
+	{
+		auto const & phase = phases[i];
+		bool const finished = (int(i) != openPhase);
+		qint64 const duration = durationOf(i);
+		QString text = QString("%0 %1 ms").arg(phase.name).arg(to_ms(duration), 0, 'f', 1);
+		if(phase.bytes > 0)
+			text += QString(" (%0 B/s)").arg(throughput(phase.bytes, duration), 0, 'f', 0);
+		if(phase.retries > 0)
+			text += QString(" [%0 retries]").arg(phase.retries);
+		if(phase.count > 1)
+			text += QString(" (%0x)").arg(phase.count);
+		if(not phase.success or not finished)
+			text += " FAILED";
+		parts << text;
+
+		success &= phase.success and finished;
+	}
+
+	return QString("session: %0 ms, %1 bytes, %2 retries, %3 | %4")
+		.arg(to_ms(total), 0, 'f', 1)
+		.arg(totalBytes())
+		.arg(totalRetries())
+		.arg(success ? "ok" : "failed")
+		.arg(parts.join(", "));
+}
+
+bool SessionReport::append(const QString & fileName) const
+{
+	QFile file(fileName);
+	if(not file.open(QFile::WriteOnly | QFile::Append))
+		return false;
+	file.write(QJsonDocument(toJson()).toJson(QJsonDocument::Compact));
+	file.write("\n");
+	return true;
+}
+
+qint64 SessionReport::elapsed() const
+{
+	return timer.nsecsElapsed();
+}
+
+qint64 SessionReport::sessionDuration() const
+{
+	return active ? elapsed() : finishedAfter;
+}
+
+qint64 SessionReport::durationOf(size_t index) const
+{
+	qint64 duration = phases[index].duration;
+	if(int(index) == openPhase)
+		duration += elapsed() - openSince;
+	return duration;
+}
@@ -0,0 +1,79 @@
+#ifndef SESSIONREPORT_HPP
+#define SESSIONREPORT_HPP
+
+#include <QString>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <vector>
+
+//! Records wall clock timing, transferred bytes and retries of
+//! each phase of a flashing session (sync, upload, erase, …).
+class SessionReport
+{
+public:
+	struct Phase
+	{
+		QString name;
+		qint64 start;         // ns since session start
+		qint64 duration = 0;  // ns, accumulated over all runs
+		qint64 bytes = 0;
+		int retries = 0;
+		int count = 0;        // number of finished runs
+		bool success = true;
+	};
+
+private:
+	QElapsedTimer timer;
+	QDateTime started;
+	QString portName;
+	qint32 baudRate = 0;
+	std::vector<Phase> phases;
+	int openPhase = -1;
+	qint64 openSince = 0;
+	qint64 finishedAfter = 0;
+	bool active = false;
+
+public:
+	//! Starts a new session and discards all previous phases.
+	void start(QString const & port, qint32 baud);
+
+	//! Closes the current phase and the session.
+	void finish();
+
+	bool isActive() const { return active; }
+
+	//! Opens a phase. An already open phase is closed successfully.
+	//! Phases with the same name are accumulated into a single entry.
+	void beginPhase(QString const & name);
+
+	//! Closes the currently open phase, does nothing if none is open.
+	void endPhase(bool success = true);
+
+	bool hasOpenPhase() const;
+
+	void addBytes(qint64 count);
+
+	void addRetry();
+
+	qint64 totalBytes() const;
+
+	int totalRetries() const;
+
+	QJsonObject toJson() const;
+
+	//! Returns a single line with the important numbers of the session.
+	QString summary() const;
+
+	//! Appends the report as a single JSON line to the given file.
+	bool append(QString const & fileName) const;
+
+private:
+	qint64 elapsed() const;
+
+	qint64 sessionDuration() const;
+
+	qint64 durationOf(size_t index) const;
+};
+
+#endif // SESSIONREPORT_HPP
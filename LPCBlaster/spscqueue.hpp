@@ -0,0 +1,45 @@
+#ifndef SPSCQUEUE_HPP
+#define SPSCQUEUE_HPP
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+//! Bounded lock-free queue between exactly one producer and one consumer
+//! thread. Each index is written by one side only, so no locks are needed.
+template<typename T, size_t N>
+class SpscQueue
+{
+	static_assert(N > 0 and (N & (N - 1)) == 0, "capacity must be a power of two");
+
+	std::array<T, N> items;
+	alignas(64) std::atomic<size_t> head { 0 }; // next item to fill, owned by the producer
+	alignas(64) std::atomic<size_t> tail { 0 }; // next item to take, owned by the consumer
+
+public:
+	//! Producer side. Returns false and leaves `value` untouched if the queue is full.
+	bool push(T && value)
+	{
+		size_t const h = head.load(std::memory_order_relaxed);
+		if(h - tail.load(std::memory_order_acquire) == N)
+			return false;
+		items[h & (N - 1)] = std::move(value);
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	//! Consumer side. Returns false if the queue is empty.
+	bool pop(T & value)
+	{
+		size_t const t = tail.load(std::memory_order_relaxed);
+		if(t == head.load(std::memory_order_acquire))
+			return false;
+		value = std::move(items[t & (N - 1)]);
+		items[t & (N - 1)] = T();
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+};
+
+#endif // SPSCQUEUE_HPP
@@ -0,0 +1,87 @@
+#include "stage0command.hpp"
+#include "../BlasterFirmware/crc32.hpp"
+
+static QByteArray const blasterReady = "LPCBlaster ready.\r\n";
+
+Stage0Command::Stage0Command(const QByteArray & firmware, uint32_t load_address, uint32_t entry, uint32_t initialized, qint32 current_baud_rate, qint32 baud_rate)
+{
+	Blaster::Request baud;
+	baud.packet.append('S');
+	Blaster::append<uint32_t>(baud.packet, uint32_t(current_baud_rate));
+	Blaster::append<uint32_t>(baud.packet, uint32_t(baud_rate));
+	baud.phase = "baud";
+	baud.onReply = [this, baud_rate](Blaster::Reply const & reply)
+	{
+		if(not reply.ack) {
+			// not fatal, the firmware is just uploaded slower
+			owner->logLine(QString("stage 0 cannot use %0 baud, staying at %1 baud")
+				.arg(baud_rate)
+				.arg(port().baudRate()));
+			return true;
+		}
+		port().setBaudRate(baud_rate);
+		port().clear();
+		return true;
+	};
+	enqueue(std::move(baud));
+
+	Blaster::Request check;
+	check.packet.append('C');
+	Blaster::append<uint32_t>(check.packet, load_address);
+	Blaster::append<uint32_t>(check.packet, initialized);
+	Blaster::append<uint32_t>(check.packet, entry);
+	Blaster::append<uint32_t>(check.packet, crc32::compute(firmware.constData(), initialized));
+	check.phase = "check";
+	check.payloadSize = [](QByteArray const &) { return blasterReady.size(); };
+	check.onReply = [this, firmware, load_address, entry](Blaster::Reply const & reply)
+	{
+		if(not reply.ack) {
+			if(reply.error != ErrorCode::InvalidChecksum)
+				owner->logLine(QString("stage 0 cannot check the firmware: %0 (%1)")
+					.arg(Blaster::errorName(reply.error))
+					.arg(reply.info));
+			enqueue(loadRequest(firmware, load_address, entry));
+			return true;
+		}
+		if(reply.payload != blasterReady) {
+			owner->logLine(QString("unexpected greeting from the firmware"));
+			return false;
+		}
+		owner->logLine(QString("LPCBlaster still resident, started at %0 baud").arg(port().baudRate()));
+		owner->idleState = MainWindow::LPCBlasterReady;
+		return true;
+	};
+	enqueue(std::move(check));
+}
+
+Blaster::Request Stage0Command::loadRequest(const QByteArray & firmware, uint32_t load_address, uint32_t entry)
+{
+	Blaster::Request load;
+	load.packet.append('G');
+	Blaster::append<uint32_t>(load.packet, load_address);
+	Blaster::append<uint32_t>(load.packet, uint32_t(firmware.size()));
+	Blaster::append<uint32_t>(load.packet, entry);
+	load.packet.append(firmware);
+	Blaster::append<uint16_t>(load.packet, Blaster::checksum(firmware));
+	load.phase = "upload";
+	load.bytes = firmware.size();
+	// the started firmware greets right after the ACK
+	load.payloadSize = [](QByteArray const &) { return blasterReady.size(); };
+	load.onReply = [this](Blaster::Reply const & reply)
+	{
+		if(not reply.ack) {
+			owner->logLine(QString("stage 0 failed to load the firmware: %0 (%1)")
+				.arg(Blaster::errorName(reply.error))
+				.arg(reply.info));
+			return false;
+		}
+		if(reply.payload != blasterReady) {
+			owner->logLine(QString("unexpected greeting from the firmware"));
+			return false;
+		}
+		owner->logLine(QString("LPCBlaster started at %0 baud").arg(port().baudRate()));
+		owner->idleState = MainWindow::LPCBlasterReady;
+		return true;
+	};
+	return load;
+}
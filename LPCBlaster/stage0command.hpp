@@ -0,0 +1,26 @@
+#ifndef STAGE0COMMAND_HPP
+#define STAGE0COMMAND_HPP
+
+#include "blaster.hpp"
+
+//! Talks to the stage 0 loader (see BlasterStage0/stage0.cpp): switches to
+//! a faster baud rate and starts the LPCBlaster firmware. The firmware is
+//! only uploaded if it is not still in RAM from a previous session, which
+//! is checked on the first `initialized` bytes (the image without .bss).
+//! Finishes when the firmware has reported that it is ready.
+struct Stage0Command : Blaster::SequenceCommand
+{
+	explicit Stage0Command(
+		QByteArray const & firmware,
+		uint32_t load_address,
+		uint32_t entry,
+		uint32_t initialized,
+		qint32 current_baud_rate,
+		qint32 baud_rate
+	);
+
+private:
+	Blaster::Request loadRequest(QByteArray const & firmware, uint32_t load_address, uint32_t entry);
+};
+
+#endif // STAGE0COMMAND_HPP
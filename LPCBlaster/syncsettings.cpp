@@ -0,0 +1,25 @@
+#include "syncsettings.hpp"
+
+#include <QSettings>
+#include <algorithm>
+
+int SyncSettings::backoff(int timeoutMs, int attempt) const
+{
+	return std::min(timeoutMs << std::min(attempt, 16), std::max(timeoutMs, maxTimeoutMs));
+}
+
+SyncSettings SyncSettings::load(const QString & fileName)
+{
+	SyncSettings result;
+	QSettings settings(fileName, QSettings::IniFormat);
+	settings.beginGroup("sync");
+	result.resetPulseMs      = settings.value("resetPulseMs", result.resetPulseMs).toInt();
+	result.bootDelayMs       = settings.value("bootDelayMs", result.bootDelayMs).toInt();
+	result.responseTimeoutMs = settings.value("responseTimeoutMs", result.responseTimeoutMs).toInt();
+	result.maxTimeoutMs      = settings.value("maxTimeoutMs", result.maxTimeoutMs).toInt();
+	result.maxAttempts       = std::max(1, settings.value("maxAttempts", result.maxAttempts).toInt());
+	result.probeTimeoutMs    = settings.value("probeTimeoutMs", result.probeTimeoutMs).toInt();
+	result.crystalKHz        = settings.value("crystalKHz", result.crystalKHz).toByteArray();
+	settings.endGroup();
+	return result;
+}
@@ -0,0 +1,25 @@
+#ifndef SYNCSETTINGS_HPP
+#define SYNCSETTINGS_HPP
+
+#include <QString>
+#include <QByteArray>
+
+//! Timing of the reset and ISP synchronization sequence.
+//! The defaults can be overridden in the [sync] group of LPCBlaster.ini.
+struct SyncSettings
+{
+	int resetPulseMs = 20;        // length of the reset pulse
+	int bootDelayMs = 5;          // delay between releasing reset and sending "?"
+	int responseTimeoutMs = 100;  // time to wait for each answer of the handshake
+	int maxTimeoutMs = 1000;      // upper limit of the timeouts when backing off
+	int maxAttempts = 6;          // number of resets before giving up
+	int probeTimeoutMs = 50;      // time to wait for a still synchronized ISP, 0 disables the probe
+	QByteArray crystalKHz = "12000";
+
+	//! Returns the timeout of the given attempt, doubling with each retry.
+	int backoff(int timeoutMs, int attempt) const;
+
+	static SyncSettings load(QString const & fileName);
+};
+
+#endif // SYNCSETTINGS_HPP
@@ -0,0 +1,328 @@
+#include "transport.hpp"
+
+#include <QDebug>
+#include <QMetaObject>
+#include <QTimer>
+#include <cassert>
+#include <cstring>
+
+std::unique_ptr<Transport> Transport::create(const QString & address)
+{
+	if(address == "loopback")
+		return std::make_unique<LoopbackTransport>();
+	if(address.startsWith("tcp://"))
+		return std::make_unique<TcpTransport>(QUrl(address));
+	return std::make_unique<SerialTransport>(address);
+}
+
+Transport::Transport(std::unique_ptr<QIODevice> && device) :
+	io(std::move(device)),
+	stream(*this)
+{
+	io->moveToThread(&ioThread);
+	QObject::connect(io.get(), &QIODevice::readyRead, io.get(), [this]() { receive(); });
+	ioThread.setObjectName("transport");
+	ioThread.start();
+}
+
+Transport::~Transport()
+{
+	// hand the device back, it is destroyed on this thread
+	QThread * const owner = QThread::currentThread();
+	call([this, owner]() {
+		io->close();
+		io->moveToThread(owner);
+	});
+	ioThread.quit();
+	ioThread.wait();
+}
+
+void Transport::call(const std::function<void()> & f)
+{
+	QMetaObject::invokeMethod(io.get(), f, Qt::BlockingQueuedConnection);
+}
+
+bool Transport::open()
+{
+	bool ok = false;
+	call([this, &ok]() { ok = openDevice(); });
+	if(ok)
+		stream.open(QIODevice::ReadWrite);
+	return ok;
+}
+
+void Transport::close()
+{
+	outgoing.clear();
+	call([this]() {
+		QByteArray chunk;
+		while(sending.pop(chunk))
+			;
+		unqueued.clear();
+		io->close();
+	});
+	stream.discard();
+	stream.close();
+}
+
+QString Transport::errorString()
+{
+	QString error;
+	call([this, &error]() { error = io->errorString(); });
+	return error;
+}
+
+void Transport::clear()
+{
+	outgoing.clear();
+	call([this]() {
+		QByteArray chunk;
+		while(sending.pop(chunk))
+			;
+		unqueued.clear();
+		clearDevice();
+	});
+	stream.discard();
+}
+
+void Transport::write(const QByteArray & data)
+{
+	outgoing.append(data);
+	if(flushScheduled)
+		return;
+	flushScheduled = true;
+	QTimer::singleShot(0, &stream, [this]() { flush(); });
+}
+
+void Transport::flush()
+{
+	flushScheduled = false;
+	if(outgoing.isEmpty() or not isOpen())
+		return;
+	if(not sending.push(std::move(outgoing))) {
+		// send() flushes again once it emptied the queue, unless it did
+		// so before it could see the flag
+		sendStalled = true;
+		if(not sending.push(std::move(outgoing)))
+			return;
+	}
+	outgoing.clear();
+	if(not sendNotified.exchange(true))
+		QMetaObject::invokeMethod(io.get(), [this]() { send(); }, Qt::QueuedConnection);
+}
+
+void Transport::send()
+{
+	sendNotified = false;
+	QByteArray chunk;
+	while(sending.pop(chunk))
+		io->write(chunk);
+	if(sendStalled.exchange(false))
+		QMetaObject::invokeMethod(&stream, [this]() { flush(); }, Qt::QueuedConnection);
+}
+
+void Transport::receive()
+{
+	for(;;)
+	{
+		if(unqueued.isEmpty())
+			unqueued = io->read(maxChunkSize);
+		if(unqueued.isEmpty())
+			break;
+		if(not received.push(std::move(unqueued))) {
+			// Stream::collect() calls receive() again once it emptied the
+			// queue, unless it did so before it could see the flag
+			receiveStalled = true;
+			if(not received.push(std::move(unqueued)))
+				break;
+		}
+		unqueued.clear();
+	}
+
+	if(not receiveNotified.exchange(true))
+		QMetaObject::invokeMethod(&stream, [this]() {
+			receiveNotified = false;
+			emit stream.readyRead();
+		}, Qt::QueuedConnection);
+}
+
+void Transport::Stream::collect() const
+{
+	QByteArray chunk;
+	while(owner.received.pop(chunk))
+		data.append(chunk);
+	if(owner.receiveStalled.exchange(false))
+		QMetaObject::invokeMethod(owner.io.get(), [this]() { owner.receive(); }, Qt::QueuedConnection);
+}
+
+qint64 Transport::Stream::bytesAvailable() const
+{
+	collect();
+	return data.size() + QIODevice::bytesAvailable();
+}
+
+bool Transport::Stream::canReadLine() const
+{
+	collect();
+	return data.contains('\n') or QIODevice::canReadLine();
+}
+
+void Transport::Stream::discard()
+{
+	collect();
+	data.clear();
+	if(isOpen())
+		QIODevice::readAll();
+}
+
+qint64 Transport::Stream::readData(char * buffer, qint64 size)
+{
+	collect();
+	qint64 const count = std::min<qint64>(size, data.size());
+	std::memcpy(buffer, data.constData(), size_t(count));
+	data.remove(0, int(count));
+	return count;
+}
+
+qint64 Transport::Stream::writeData(const char * buffer, qint64 size)
+{
+	owner.write(QByteArray(buffer, int(size)));
+	return size;
+}
+
+SerialTransport::SerialTransport(const QString & portName) :
+	Transport(std::make_unique<QSerialPort>()),
+	port(static_cast<QSerialPort &>(backend())),
+	portName(portName)
+{
+	QObject::connect(&port, &QSerialPort::errorOccurred, [](QSerialPort::SerialPortError err) {
+		qDebug() << "serial port error:" << err;
+	});
+}
+
+bool SerialTransport::openDevice()
+{
+	port.setPortName(portName);
+	if(not port.open(QSerialPort::ReadWrite))
+		return false;
+
+	bool good = true;
+	good &= port.setBaudRate(115200);
+	good &= port.setDataBits(QSerialPort::Data8);
+	good &= port.setStopBits(QSerialPort::OneStop);
+	good &= port.setParity(QSerialPort::NoParity);
+	good &= port.setFlowControl(QSerialPort::SoftwareControl);
+
+	port.setReadBufferSize(1 << 20); // 1 MB
+
+	assert(good);
+	baud = 115200;
+	return true;
+}
+
+bool SerialTransport::setBaudRate(qint32 baud)
+{
+	// queued data still leaves with the old rate
+	flush();
+	bool ok = false;
+	call([this, baud, &ok]() { ok = port.setBaudRate(baud); });
+	if(ok)
+		this->baud = baud;
+	return ok;
+}
+
+void SerialTransport::setFlowControl(QSerialPort::FlowControl flow)
+{
+	flush();
+	call([this, flow]() { port.setFlowControl(flow); });
+}
+
+void SerialTransport::setRequestToSend(bool enabled)
+{
+	call([this, enabled]() { port.setRequestToSend(enabled); });
+}
+
+void SerialTransport::setDataTerminalReady(bool enabled)
+{
+	call([this, enabled]() { port.setDataTerminalReady(enabled); });
+}
+
+void SerialTransport::clearDevice()
+{
+	port.clear(); // flush FIFOs
+}
+
+TcpTransport::TcpTransport(const QUrl & url) :
+	Transport(std::make_unique<QTcpSocket>()),
+	socket(static_cast<QTcpSocket &>(backend())),
+	url(url)
+{
+	QObject::connect(&socket, &QTcpSocket::errorOccurred, [](QAbstractSocket::SocketError err) {
+		qDebug() << "socket error:" << err;
+	});
+}
+
+QString TcpTransport::name() const
+{
+	return QString("%0:%1").arg(url.host()).arg(url.port());
+}
+
+bool TcpTransport::openDevice()
+{
+	if(url.host().isEmpty() or url.port() < 0) {
+		qDebug() << "expected tcp://host:port";
+		return false;
+	}
+	socket.connectToHost(url.host(), quint16(url.port()));
+	if(not socket.waitForConnected(connectTimeoutMs))
+		return false;
+
+	// the protocol is request/reply with small packets, don't let them
+	// wait for the ACK of the previous segment
+	socket.setSocketOption(QAbstractSocket::LowDelayOption, 1);
+	socket.setSocketOption(QAbstractSocket::KeepAliveOption, 1);
+	return true;
+}
+
+qint64 LoopbackDevice::bytesAvailable() const
+{
+	return data.size() + QIODevice::bytesAvailable();
+}
+
+bool LoopbackDevice::canReadLine() const
+{
+	return data.contains('\n') or QIODevice::canReadLine();
+}
+
+qint64 LoopbackDevice::readData(char * buffer, qint64 size)
+{
+	qint64 const count = std::min<qint64>(size, data.size());
+	std::memcpy(buffer, data.constData(), size_t(count));
+	data.remove(0, int(count));
+	return count;
+}
+
+qint64 LoopbackDevice::writeData(const char * buffer, qint64 size)
+{
+	data.append(buffer, int(size));
+	QTimer::singleShot(0, this, [this]() { emit readyRead(); });
+	return size;
+}
+
+LoopbackTransport::LoopbackTransport() :
+	Transport(std::make_unique<LoopbackDevice>()),
+	loopback(static_cast<LoopbackDevice &>(backend()))
+{
+}
+
+bool LoopbackTransport::openDevice()
+{
+	loopback.discard();
+	return loopback.open(QIODevice::ReadWrite);
+}
+
+void LoopbackTransport::clearDevice()
+{
+	loopback.discard();
+	loopback.readAll();
+}
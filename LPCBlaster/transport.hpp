@@ -0,0 +1,221 @@
+#ifndef TRANSPORT_HPP
+#define TRANSPORT_HPP
+
+#include <QByteArray>
+#include <QIODevice>
+#include <QSerialPort>
+#include <QString>
+#include <QTcpSocket>
+#include <QThread>
+#include <QUrl>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+#include "spscqueue.hpp"
+
+//! Byte stream to the target: a local serial port, a serial port behind
+//! a raw TCP server (ser2net and the like) or an in-process loopback.
+//!
+//! The device runs on its own I/O thread, so it is read and written while
+//! the GUI is busy. Data passes between the threads in chunks through two
+//! lock-free queues, the GUI thread only sees device(), a sequential
+//! QIODevice on its end of the queues.
+//!
+//! Writes are collected and handed to the I/O thread once per event loop
+//! iteration, so a sequence of small packets leaves in one batch.
+class Transport
+{
+public:
+	//! Chunks of data between the GUI and the I/O thread.
+	using Queue = SpscQueue<QByteArray, 1024>;
+
+	//! Largest chunk read from the device at once.
+	static constexpr qint64 maxChunkSize = 64 * 1024;
+
+private:
+	//! GUI end of the queues.
+	class Stream : public QIODevice
+	{
+		Transport & owner;
+		mutable QByteArray data; // taken from the receive queue, not yet read
+
+	public:
+		explicit Stream(Transport & owner) : owner(owner) { }
+
+		bool isSequential() const override { return true; }
+		qint64 bytesAvailable() const override;
+		bool canReadLine() const override;
+
+		//! Drops all received data.
+		void discard();
+
+	protected:
+		qint64 readData(char * buffer, qint64 size) override;
+		qint64 writeData(char const * buffer, qint64 size) override;
+
+	private:
+		//! Moves the chunks from the receive queue to `data`.
+		void collect() const;
+	};
+
+	std::unique_ptr<QIODevice> io; // lives on ioThread
+	QThread ioThread;
+	Stream stream;
+
+	Queue received;
+	Queue sending;
+	QByteArray unqueued; // read on the I/O thread while `received` was full
+
+	std::atomic<bool> receiveNotified { false }; // readyRead of the stream is posted
+	std::atomic<bool> receiveStalled { false };  // `received` was full
+	std::atomic<bool> sendNotified { false };    // send() is posted
+	std::atomic<bool> sendStalled { false };     // `sending` was full
+
+	QByteArray outgoing;
+	bool flushScheduled = false;
+
+public:
+	virtual ~Transport();
+
+	//! Creates the transport for `address`:
+	//!   tcp://host:port   serial port behind a raw TCP server
+	//!   loopback          everything written is read back
+	//!   anything else     name of a local serial port (ttyUSB0, COM3)
+	static std::unique_ptr<Transport> create(QString const & address);
+
+	//! The GUI end of the transport.
+	QIODevice & device() { return stream; }
+
+	//! Name for the log and the session report.
+	virtual QString name() const = 0;
+
+	//! Opens the device with 115200 baud, 8N1 and software flow control.
+	bool open();
+
+	void close();
+
+	bool isOpen() const { return stream.isOpen(); }
+
+	QString errorString();
+
+	// line settings and modem lines, ignored where the transport has none
+
+	virtual bool canChangeBaudRate() const { return false; }
+	virtual bool setBaudRate(qint32 baud) { return baud == baudRate(); }
+	virtual qint32 baudRate() const { return 115200; }
+	virtual void setFlowControl(QSerialPort::FlowControl) { }
+	virtual void setRequestToSend(bool) { }
+	virtual void setDataTerminalReady(bool) { }
+
+	//! Discards unsent data and all data received so far.
+	void clear();
+
+	//! Queues `data` to be sent.
+	void write(QByteArray const & data);
+
+	//! Hands the queued data to the I/O thread.
+	void flush();
+
+	QByteArray read(qint64 size) { return stream.read(size); }
+	QByteArray peek(qint64 size) { return stream.peek(size); }
+	QByteArray readAll() { return stream.readAll(); }
+	QByteArray readLine() { return stream.readLine(); }
+	bool canReadLine() { return stream.canReadLine(); }
+	bool atEnd() { return stream.atEnd(); }
+	qint64 bytesAvailable() { return stream.bytesAvailable(); }
+
+protected:
+	explicit Transport(std::unique_ptr<QIODevice> && device);
+
+	QIODevice & backend() { return *io; }
+
+	//! Runs `f` on the I/O thread and waits until it returned.
+	void call(std::function<void()> const & f);
+
+	//! Opens the device, called on the I/O thread.
+	virtual bool openDevice() = 0;
+
+	//! Discards the data buffered by the device, called on the I/O thread.
+	virtual void clearDevice() { io->readAll(); }
+
+private:
+	// I/O thread
+	void receive();
+	void send();
+};
+
+class SerialTransport : public Transport
+{
+	QSerialPort & port;
+	QString portName;
+	qint32 baud = 115200;
+
+public:
+	explicit SerialTransport(QString const & portName);
+
+	QString name() const override { return portName; }
+
+	bool canChangeBaudRate() const override { return true; }
+	bool setBaudRate(qint32 baud) override;
+	qint32 baudRate() const override { return baud; }
+	void setFlowControl(QSerialPort::FlowControl flow) override;
+	void setRequestToSend(bool enabled) override;
+	void setDataTerminalReady(bool enabled) override;
+
+protected:
+	bool openDevice() override;
+	void clearDevice() override;
+};
+
+//! Raw TCP connection to a serial server. The line settings are those
+//! configured on the server, RTS and DTR are not available, so the
+//! target has to be reset into the ISP by hand.
+class TcpTransport : public Transport
+{
+	QTcpSocket & socket;
+	QUrl url;
+
+public:
+	static constexpr int connectTimeoutMs = 3000;
+
+	explicit TcpTransport(QUrl const & url);
+
+	QString name() const override;
+
+protected:
+	bool openDevice() override;
+};
+
+//! In-process device that reads back everything written to it.
+class LoopbackDevice : public QIODevice
+{
+	QByteArray data;
+
+public:
+	bool isSequential() const override { return true; }
+	qint64 bytesAvailable() const override;
+	bool canReadLine() const override;
+
+	void discard() { data.clear(); }
+
+protected:
+	qint64 readData(char * buffer, qint64 size) override;
+	qint64 writeData(char const * buffer, qint64 size) override;
+};
+
+class LoopbackTransport : public Transport
+{
+	LoopbackDevice & loopback;
+
+public:
+	LoopbackTransport();
+
+	QString name() const override { return "loopback"; }
+
+protected:
+	bool openDevice() override;
+	void clearDevice() override;
+};
+
+#endif // TRANSPORT_HPP